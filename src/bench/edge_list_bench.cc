@@ -0,0 +1,102 @@
+/* ~~~~~~~~~~~~~~~~ Notes ~~~~~~~~~~~~~~~~ */
+// Load-time benchmark for load_edge_list.
+//
+// The edge list is scaled up synthetically by writing `copies` disjoint copies
+// of it (vertex ids shifted by the number of vertices of the original) to a
+// temporary file. That file is then loaded with the getline + stringstream
+// parser that load_edge_list used to be, and with the memory-mapped parser on
+// 1 and `threads` threads. The parsed edge lists must be identical.
+//
+// Usage:
+//   bin/edge_list_bench <edge_list_path> [copies] [threads] [tmp_path]
+
+/* ~~~~~~~~~~~~~~~~ Includes ~~~~~~~~~~~~~~~~ */
+// STL
+#include <iostream>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+// Program headers
+#include "../types.hh"
+#include "../graph_utilities.hh"
+
+using bench_clock_t = std::chrono::steady_clock;
+
+double elapsed_ms(bench_clock_t::time_point since) {
+    return std::chrono::duration<double, std::milli>(bench_clock_t::now() - since).count();
+}
+
+/* The parser load_edge_list used before it was memory-mapped. */
+bool load_edge_list_getline(edge_list_t &edge_list, const std::string& edge_list_path) {
+    edge_list.clear();
+    std::ifstream edge_list_file(edge_list_path.c_str());
+    if (!edge_list_file.is_open()) return false;
+    std::string line_buffer;
+    size_t node_a, node_b;
+    while (getline(edge_list_file, line_buffer)) {
+        std::stringstream linestream(line_buffer);
+        linestream >> node_a;
+        linestream >> node_b;
+        edge_list.push_back(std::make_pair(node_a, node_b));
+    }
+    edge_list_file.close();
+    return true;
+}
+
+int main(int argc, char const *argv[]) {
+    if (argc < 2) {
+        std::clog << "Usage:\n"
+                  << "  " + std::string(argv[0]) + " <edge_list_path> [copies] [threads] [tmp_path]\n";
+        return 1;
+    }
+    std::string edge_list_path = argv[1];
+    size_t copies = argc > 2 ? std::stoul(argv[2]) : 100;
+    size_t threads = argc > 3 ? std::stoul(argv[3]) : 0;
+    std::string scaled_path = argc > 4 ? argv[4] : edge_list_path + ".scaled.tmp";
+
+    edge_list_t original;
+    if (!load_edge_list(original, edge_list_path)) {
+        std::cerr << "Cannot open " << edge_list_path << "\n";
+        return 1;
+    }
+    size_t num_vertices = 0;
+    for (auto const& edge: original) {
+        num_vertices = std::max(num_vertices, std::max(edge.first, edge.second) + 1);
+    }
+    {
+        std::ofstream scaled(scaled_path.c_str());
+        for (size_t c = 0; c < copies; ++c) {
+            size_t shift = c * num_vertices;
+            for (auto const& edge: original) {
+                scaled << edge.first + shift << "\t" << edge.second + shift << "\n";
+            }
+        }
+    }
+
+    edge_list_t reference;
+    edge_list_t edge_list;
+    auto t0 = bench_clock_t::now();
+    load_edge_list_getline(reference, scaled_path);
+    double getline_ms = elapsed_ms(t0);
+
+    t0 = bench_clock_t::now();
+    load_edge_list(edge_list, scaled_path, 1);
+    double mmap_ms = elapsed_ms(t0);
+    bool same = edge_list == reference;
+
+    t0 = bench_clock_t::now();
+    load_edge_list(edge_list, scaled_path, threads);
+    double mmap_threads_ms = elapsed_ms(t0);
+    same = same && edge_list == reference;
+    std::remove(scaled_path.c_str());
+
+    std::cout << "graph: " << edge_list_path << " x " << copies << " (" << reference.size() << " edges)\n";
+    std::cout << "getline + stringstream: " << getline_ms << " ms\n";
+    std::cout << "mmap, 1 thread: " << mmap_ms << " ms (x" << getline_ms / mmap_ms << ")\n";
+    std::cout << "mmap, " << (threads == 0 ? std::string("all") : std::to_string(threads)) << " threads: "
+              << mmap_threads_ms << " ms (x" << getline_ms / mmap_threads_ms << ")\n";
+    std::cout << "identical edge lists: " << (same ? "yes" : "no") << "\n";
+    return same ? 0 : 1;
+}
@@ -0,0 +1,277 @@
+/* ~~~~~~~~~~~~~~~~ Notes ~~~~~~~~~~~~~~~~ */
+// Microbenchmarks for the MCMC kernels.
+//
+// For every point of a grid over N, the average degree, (KA, KB) and the degree
+// skew, a synthetic degree-corrected bipartite SBM is generated with a fixed
+// seed and a blockmodel_t is built on its planted partition. Each kernel is
+// then timed on pre-sampled inputs, for at least `min_ms` milliseconds:
+//
+//   single_vertex_change   proposal for a random vertex (includes the RNG)
+//   transition_ratio       dS and acceptance ratio of a proposed vertex move
+//   apply_mcmc_moves       a vertex move, immediately undone by the reverse move
+//   compute_dS/vertex      the vertex-move overload of compute_dS
+//   compute_dS/block       merge of two random blocks of the same type
+//   compute_dS/split       split of a random block (O(N) per call)
+//
+// The degree skew is the tail exponent `alpha` of a Pareto distribution from
+// which vertex propensities are drawn; alpha = 0 gives uniform propensities.
+// The state is only perturbed transiently, so every kernel sees the same
+// partition. Results are printed as a table and, with --json, written as JSON
+// so that two releases can be diffed.
+//
+// Usage:
+//   bin/mcmc_bench [--quick] [--min_ms <ms>] [--seed <seed>] [--json <path>]
+
+/* ~~~~~~~~~~~~~~~~ Includes ~~~~~~~~~~~~~~~~ */
+// STL
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+// Program headers
+#include "../types.hh"
+#include "../blockmodel.hh"
+#include "../csr_graph.hh"
+#include "../metropolis_hasting.hh"
+#include "../support/move_kernel.hh"
+
+using bench_clock_t = std::chrono::steady_clock;
+
+struct bench_config_t {
+    size_t N;
+    double degree;
+    size_t KA;
+    size_t KB;
+    double skew;
+};
+
+struct kernel_result_t {
+    std::string name;
+    size_t ops;
+    double ns_per_op;
+    double ops_per_s;
+};
+
+volatile double sink;  // keeps the timed results alive
+
+/* Degree-corrected bipartite SBM with planted blocks; vertex i of type A is in block i * KA / NA. */
+edge_list_t synthetic_edge_list(const bench_config_t& config, uint_vec_t& memberships, uint_vec_t& types,
+                                rng_t& engine) {
+    size_t NA = config.N / 2;
+    size_t NB = config.N - NA;
+    auto num_edges = size_t(config.degree * config.N / 2);
+    std::uniform_real_distribution<> random_real(0, 1);
+
+    std::vector<double> theta(config.N, 1.);
+    if (config.skew > 0.) {
+        for (auto& t: theta) {
+            t = std::pow(1. - random_real(engine), -1. / config.skew);
+        }
+    }
+    memberships.resize(config.N);
+    types.resize(config.N);
+    std::vector<std::vector<size_t>> members(config.KA + config.KB);
+    std::vector<std::vector<double>> weights(config.KA + config.KB);
+    for (size_t i = 0; i < config.N; ++i) {
+        types[i] = i < NA ? 0 : 1;
+        memberships[i] = i < NA ? unsigned(i * config.KA / NA) : unsigned(config.KA + (i - NA) * config.KB / NB);
+        members[memberships[i]].push_back(i);
+        weights[memberships[i]].push_back(theta[i]);
+    }
+    std::discrete_distribution<size_t> pick_a(theta.begin(), theta.begin() + NA);
+    std::vector<std::discrete_distribution<size_t>> pick_in_block;
+    for (size_t r = 0; r < config.KA + config.KB; ++r) {
+        pick_in_block.emplace_back(weights[r].begin(), weights[r].end());
+    }
+
+    // 80% of the edges stay on the planted diagonal r -> r % KB, the rest go to a uniform block of type B.
+    edge_list_t edge_list;
+    edge_list.reserve(num_edges);
+    for (size_t e = 0; e < num_edges; ++e) {
+        size_t i = pick_a(engine);
+        size_t r = memberships[i];
+        size_t s = config.KA + (random_real(engine) < 0.8 ? r % config.KB : size_t(random_real(engine) * config.KB));
+        size_t j = members[s][pick_in_block[s](engine)];
+        edge_list.emplace_back(i, j);
+    }
+    return edge_list;
+}
+
+/* Run `op(i)` over i = 0, 1, ... (modulo `period`) until `min_ms` have elapsed, in batches of `batch`.
+ * One untimed pass over the inputs comes first, so that the lazily grown caches are in place. */
+template<class Op>
+kernel_result_t time_kernel(const std::string& name, size_t period, size_t batch, double min_ms, Op op) {
+    for (size_t i = 0; i < period; ++i) {
+        op(i);
+    }
+    size_t ops = 0;
+    double elapsed_ns = 0.;
+    auto t0 = bench_clock_t::now();
+    while (elapsed_ns < min_ms * 1e6) {
+        for (size_t b = 0; b < batch; ++b, ++ops) {
+            op(ops % period);
+        }
+        elapsed_ns = std::chrono::duration<double, std::nano>(bench_clock_t::now() - t0).count();
+    }
+    return kernel_result_t{name, ops, elapsed_ns / ops, ops / elapsed_ns * 1e9};
+}
+
+std::vector<kernel_result_t> run_config(const bench_config_t& config, size_t seed, double min_ms,
+                                        size_t& num_edges, size_t& max_degree) {
+    rng_t engine(seed);
+    uint_vec_t memberships;
+    uint_vec_t types;
+    edge_list_t edge_list = synthetic_edge_list(config, memberships, types, engine);
+    size_t NA = config.N / 2;
+    const csr_graph_t graph(edge_list, config.N, NA, config.N - NA);
+    edge_list.clear();
+
+    blockmodel_t blockmodel(memberships, types, config.KA + config.KB, config.KA, config.KB, 1., &graph);
+    blockmodel.init_bisbm();
+    num_edges = graph.num_edges();
+    max_degree = 0;
+    for (size_t v = 0; v < config.N; ++v) {
+        max_degree = std::max(max_degree, graph.degree(v));
+    }
+
+    metropolis_hasting algorithm;
+    const size_t pool = 4096;
+    std::uniform_int_distribution<size_t> random_vertex(0, config.N - 1);
+    std::vector<size_t> vertices(pool);
+    std::vector<std::vector<mcmc_move_t>> proposals(pool);
+    std::vector<std::vector<mcmc_move_t>> undo(pool);
+    for (size_t i = 0; i < pool; ++i) {
+        vertices[i] = random_vertex(engine);
+        proposals[i] = algorithm.sample_proposal_distribution(blockmodel, vertices[i], engine);
+        const mcmc_move_t& move = proposals[i][0];
+        undo[i] = {mcmc_move_t{move.vertex, move.target, move.source}};
+    }
+    std::vector<block_move_t> block_moves(pool);
+    for (auto& move: block_moves) {
+        bool type_b = (engine() & 1) != 0;
+        size_t lo = type_b ? config.KA : 0;
+        size_t k = type_b ? config.KB : config.KA;
+        move.source = lo + engine() % k;
+        move.target = lo + (move.source - lo + 1 + engine() % std::max(k - 1, size_t(1))) % k;
+    }
+    const size_t split_pool = 16;
+    std::vector<size_t> split_blocks(split_pool);
+    std::vector<std::vector<bool>> split_moves(split_pool, std::vector<bool>(config.N));
+    for (size_t i = 0; i < split_pool; ++i) {
+        split_blocks[i] = engine() % (config.KA + config.KB);
+        for (size_t v = 0; v < config.N; ++v) {
+            split_moves[i][v] = (engine() & 1) != 0;
+        }
+    }
+
+    std::vector<kernel_result_t> results;
+    results.push_back(time_kernel("single_vertex_change", pool, 256, min_ms, [&](size_t i) {
+        sink = double(blockmodel.single_vertex_change(engine, vertices[i])[0].target);
+    }));
+    results.push_back(time_kernel("transition_ratio", pool, 256, min_ms, [&](size_t i) {
+        sink = algorithm.transition_ratio(blockmodel, proposals[i]);
+    }));
+    results.push_back(time_kernel("apply_mcmc_moves", pool, 256, min_ms, [&](size_t i) {
+        if (blockmodel.apply_mcmc_moves(proposals[i], 0.)) {
+            blockmodel.apply_mcmc_moves(undo[i], 0.);
+        }
+    }));
+    results.push_back(time_kernel("compute_dS/vertex", pool, 256, min_ms, [&](size_t i) {
+        sink = blockmodel.compute_dS(proposals[i][0]);
+    }));
+    results.push_back(time_kernel("compute_dS/block", pool, 256, min_ms, [&](size_t i) {
+        sink = blockmodel.compute_dS(block_moves[i]);
+    }));
+    results.push_back(time_kernel("compute_dS/split", split_pool, 1, min_ms, [&](size_t i) {
+        sink = blockmodel.compute_dS(split_blocks[i], split_moves[i]);
+    }));
+    return results;
+}
+
+int main(int argc, char const *argv[]) {
+    bool quick = false;
+    double min_ms = 200.;
+    size_t seed = 42;
+    std::string json_path;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--quick") {
+            quick = true;
+        } else if (arg == "--min_ms" && i + 1 < argc) {
+            min_ms = std::stod(argv[++i]);
+        } else if (arg == "--seed" && i + 1 < argc) {
+            seed = std::stoul(argv[++i]);
+        } else if (arg == "--json" && i + 1 < argc) {
+            json_path = argv[++i];
+        } else {
+            std::clog << "Usage:\n"
+                      << "  " + std::string(argv[0]) + " [--quick] [--min_ms <ms>] [--seed <seed>] [--json <path>]\n";
+            return 1;
+        }
+    }
+
+    std::vector<size_t> sizes = quick ? std::vector<size_t>{1000, 10000} : std::vector<size_t>{1000, 10000, 100000};
+    std::vector<double> degrees = quick ? std::vector<double>{8} : std::vector<double>{4, 16};
+    std::vector<size_t> ks = quick ? std::vector<size_t>{4, 16} : std::vector<size_t>{4, 16, 64};
+    std::vector<double> skews{0., 1.5};
+
+    std::ofstream json;
+    if (!json_path.empty()) {
+        json.open(json_path.c_str());
+        if (!json.is_open()) {
+            std::cerr << "Cannot open " << json_path << "\n";
+            return 1;
+        }
+        json << "{\n  \"benchmark\": \"mcmc_bench\",\n  \"move_kernel\": \"" << move_kernel_name()
+             << "\",\n  \"seed\": " << seed << ",\n  \"min_ms\": " << min_ms
+             << ",\n  \"configs\": [";
+    }
+
+    std::cout << "transition_ratio kernel: " << move_kernel_name() << "\n";
+    std::cout << std::left << std::setw(8) << "N" << std::setw(8) << "E" << std::setw(8) << "deg_max"
+              << std::setw(10) << "KA/KB" << std::setw(6) << "skew" << std::setw(22) << "kernel"
+              << std::right << std::setw(12) << "ns/op" << std::setw(14) << "ops/s" << "\n";
+    bool first_config = true;
+    for (auto N: sizes) {
+        for (auto degree: degrees) {
+            for (auto K: ks) {
+                for (auto skew: skews) {
+                    bench_config_t config{N, degree, K, K, skew};
+                    size_t num_edges = 0;
+                    size_t max_degree = 0;
+                    auto results = run_config(config, seed, min_ms, num_edges, max_degree);
+                    for (auto const& result: results) {
+                        std::cout << std::left << std::setw(8) << N << std::setw(8) << num_edges
+                                  << std::setw(8) << max_degree
+                                  << std::setw(10) << std::to_string(K) + "/" + std::to_string(K)
+                                  << std::setw(6) << skew << std::setw(22) << result.name << std::right
+                                  << std::setw(12) << std::fixed << std::setprecision(1) << result.ns_per_op
+                                  << std::setw(14) << std::setprecision(0) << result.ops_per_s << "\n";
+                        std::cout.unsetf(std::ios::floatfield);
+                        std::cout << std::setprecision(6);
+                    }
+                    if (json.is_open()) {
+                        json << (first_config ? "\n" : ",\n") << "    {\"N\": " << N << ", \"E\": " << num_edges
+                             << ", \"max_degree\": " << max_degree << ", \"KA\": " << K << ", \"KB\": " << K
+                             << ", \"skew\": " << skew << ", \"kernels\": {";
+                        for (auto const& result: results) {
+                            json << (&result == &results[0] ? "" : ", ") << "\"" << result.name
+                                 << "\": {\"ops\": " << result.ops << ", \"ns_per_op\": " << result.ns_per_op
+                                 << ", \"ops_per_s\": " << result.ops_per_s << "}";
+                        }
+                        json << "}}";
+                    }
+                    first_config = false;
+                }
+            }
+        }
+    }
+    if (json.is_open()) {
+        json << "\n  ]\n}\n";
+    }
+    return 0;
+}
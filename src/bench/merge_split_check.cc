@@ -0,0 +1,100 @@
+/* ~~~~~~~~~~~~~~~~ Notes ~~~~~~~~~~~~~~~~ */
+// Check of the Hastings ratio of metropolis_hasting::merge_split.
+//
+// On a 10-vertex graph (7 vertices of type a in 3 groups, 3 of type b in one),
+// the chain runs merge-split moves alone at temperature 1 and counts how often
+// it visits each partition. The type-a vertices can be split into 3 non-empty
+// labelled groups in 1806 ways, which are enumerated to get the exact posterior
+// exp(-S) / Z. The total variation distance between the visit frequencies and
+// the posterior only shrinks like sampling noise if the acceptance ratio is
+// right (about 0.024 at 2M samples, against 0.097 without the anchor term).
+// The running entropy is also checked against a recomputation at every visit.
+//
+// Usage:
+//   bin/merge_split_check [samples] [max_tv] [seed]
+//   e.g. bin/merge_split_check 2000000 0.05
+
+/* ~~~~~~~~~~~~~~~~ Includes ~~~~~~~~~~~~~~~~ */
+// STL
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+// Program headers
+#include "../types.hh"
+#include "../blockmodel.hh"
+#include "../csr_graph.hh"
+#include "../metropolis_hasting.hh"
+#include "../support/cache.hh"
+#include "../support/int_part.hh"
+
+int main(int argc, char const *argv[]) {
+    size_t samples = argc > 1 ? std::stoul(argv[1]) : 2000000;
+    double max_tv = argc > 2 ? std::stod(argv[2]) : 0.05;
+    size_t seed = argc > 3 ? std::stoul(argv[3]) : 5;
+
+    const size_t NA = 7;
+    const size_t NB = 3;
+    const size_t N = NA + NB;
+    const size_t KA = 3;
+    edge_list_t edge_list{{0, 7}, {1, 7}, {2, 7}, {3, 8}, {4, 8}, {5, 9}, {6, 9}, {0, 8}, {3, 9}, {6, 7}, {2, 8}};
+    const csr_graph_t graph(edge_list, N, NA, NB);
+    uint_vec_t types(N, 0);
+    std::fill(types.begin() + NA, types.end(), 1);
+    init_lgamma(1000);
+    init_q_cache(100, 100);
+
+    // Exact posterior over every partition of the type-a vertices into KA non-empty groups
+    std::map<uint_vec_t, double> posterior;
+    double Z = 0.;
+    size_t labellings = 1;
+    for (size_t v = 0; v < NA; ++v) {
+        labellings *= KA;
+    }
+    for (size_t c = 0; c < labellings; ++c) {
+        uint_vec_t memberships(N, unsigned(KA));
+        std::vector<size_t> sizes(KA, 0);
+        for (size_t v = 0, x = c; v < NA; ++v, x /= KA) {
+            memberships[v] = unsigned(x % KA);
+            ++sizes[memberships[v]];
+        }
+        if (std::count(sizes.begin(), sizes.end(), size_t(0)) > 0) {
+            continue;
+        }
+        blockmodel_t blockmodel(memberships, types, KA + 1, KA, 1, 1., &graph);
+        blockmodel.init_bisbm();
+        posterior[memberships] = std::exp(-blockmodel.entropy());
+        Z += posterior[memberships];
+    }
+
+    uint_vec_t memberships{0, 0, 0, 1, 1, 2, 2, 3, 3, 3};
+    blockmodel_t blockmodel(memberships, types, KA + 1, KA, 1, 1., &graph);
+    blockmodel.init_bisbm();
+    metropolis_hasting algorithm;
+    rng_t engine(seed);
+    std::map<uint_vec_t, size_t> visits;
+    double drift = 0.;
+    for (size_t t = 0; t < samples; ++t) {
+        algorithm.merge_split(blockmodel, 1., engine);
+        const uint_vec_t& state = *blockmodel.get_memberships();
+        ++visits[state];
+        drift = std::max(drift, std::abs(blockmodel.entropy() + std::log(posterior[state])));
+    }
+
+    double tv = 0.;
+    size_t visited = 0;
+    for (auto const& p: posterior) {
+        size_t n = visits.count(p.first) ? visits[p.first] : 0;
+        tv += std::abs(double(n) / double(samples) - p.second / Z);
+        visited += n > 0;
+    }
+    tv /= 2.;
+    std::cout << "partitions: " << posterior.size() << ", visited: " << visited << ", samples: " << samples << "\n";
+    std::cout << "total variation distance: " << tv << " (at most " << max_tv << ")\n";
+    std::cout << "largest entropy drift: " << drift << "\n";
+    bool ok = visits.size() == visited && tv <= max_tv && drift < 1e-6;
+    std::cout << (ok ? "OK" : "FAILED") << "\n";
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,112 @@
+/* ~~~~~~~~~~~~~~~~ Notes ~~~~~~~~~~~~~~~~ */
+// Serial against parallel sweeps of a single annealing chain.
+//
+// For every sweep mode and number of threads, the same `seeds` chains are
+// annealed from a random partition into (KA, KB) groups: `sweeps` sweeps at
+// temperature 1, then as many at temperature 0. The final entropy (mean,
+// lowest and highest over the seeds) and the sweep throughput are printed, so
+// that the staleness of the asynchronous and bulk-synchronous sweeps can be
+// checked against the serial sampler. Asynchronous sweeps with 1 thread are
+// the serial ones. Every final state is checked against a blockmodel rebuilt
+// from its memberships. The shared caches are grown before the first run, so
+// that no row pays for their lazy growth.
+//
+// Usage:
+//   bin/parallel_sweep_bench <edge_list_path> <NA> <NB> <KA> <KB> [sweeps] [seeds] [threads ...]
+//   e.g. bin/parallel_sweep_bench dataset/southernWomen.edgelist 18 14 2 2 100 20 1 2 4
+
+/* ~~~~~~~~~~~~~~~~ Includes ~~~~~~~~~~~~~~~~ */
+// STL
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <vector>
+// Program headers
+#include "../types.hh"
+#include "../blockmodel.hh"
+#include "../chains.hh"  // for warm_up_caches
+#include "../cooling_schedules.hh"
+#include "../metropolis_hasting.hh"
+#include "../graph_utilities.hh"
+
+using bench_clock_t = std::chrono::steady_clock;
+
+int main(int argc, char const *argv[]) {
+    if (argc < 6) {
+        std::cerr << "Usage: " << argv[0] << " <edge_list_path> <NA> <NB> <KA> <KB> [sweeps] [seeds] [threads ...]\n";
+        return 1;
+    }
+    std::string edge_list_path = argv[1];
+    size_t NA = std::stoul(argv[2]);
+    size_t NB = std::stoul(argv[3]);
+    size_t KA = std::stoul(argv[4]);
+    size_t KB = std::stoul(argv[5]);
+    size_t sweeps = argc > 6 ? std::stoul(argv[6]) : 100;
+    size_t seeds = argc > 7 ? std::stoul(argv[7]) : 10;
+    std::vector<size_t> thread_counts;
+    for (int i = 8; i < argc; ++i) {
+        thread_counts.push_back(std::stoul(argv[i]));
+    }
+    if (thread_counts.empty()) {
+        thread_counts = {1, 2, 4, 8};
+    }
+
+    edge_list_t edge_list;
+    if (!load_edge_list(edge_list, edge_list_path)) {
+        std::cerr << "Cannot open edge list " << edge_list_path << "\n";
+        return 1;
+    }
+    const csr_graph_t graph(edge_list, NA + NB, NA, NB);
+    edge_list.clear();
+
+    uint_vec_t types(NA + NB, 0);
+    uint_vec_t memberships(NA + NB, 0);
+    for (size_t i = 0; i < NA + NB; ++i) {
+        types[i] = i < NA ? 0 : 1;
+        memberships[i] = i < NA ? unsigned(i % KA) : unsigned(KA + (i - NA) % KB);
+    }
+    size_t N = NA + NB;
+    float_vec_t kwargs(1, float(sweeps * N));  // abrupt cooling after `sweeps` sweeps
+
+    warm_up_caches(graph, memberships, KA, KB);
+
+    std::cout << "graph: " << edge_list_path << " (N = " << N << ", E = " << graph.num_edges() << ", K = "
+              << KA + KB << "), " << 2 * sweeps << " sweeps, " << seeds << " seeds\n";
+    std::cout << "mode  threads  mean entropy  lowest  highest  sweeps/s\n";
+    size_t inconsistent = 0;
+    for (size_t run = 0; run < 2 * thread_counts.size(); ++run) {
+        bool bulk = run >= thread_counts.size();
+        size_t threads = thread_counts[run % thread_counts.size()];
+        std::vector<double> entropies;
+        double seconds = 0.;
+        for (size_t seed = 0; seed < seeds; ++seed) {
+            rng_t engine(seed);
+            blockmodel_t blockmodel(memberships, types, KA + KB, KA, KB, 1., &graph);
+            blockmodel.shuffle_bisbm(engine, NA, NB);
+            metropolis_hasting algorithm;
+            algorithm.set_num_threads(threads);
+            algorithm.set_bulk_synchronous(bulk);
+            auto t0 = bench_clock_t::now();
+            algorithm.anneal(blockmodel, abrupt_cool_schedule_t(kwargs), 2 * sweeps * N, 2 * sweeps * N, engine);
+            seconds += std::chrono::duration<double>(bench_clock_t::now() - t0).count();
+            entropies.push_back(blockmodel.entropy());
+
+            blockmodel_t rebuilt(*blockmodel.get_memberships(), types, KA + KB, KA, KB, 1., &graph);
+            rebuilt.init_bisbm();
+            if (std::abs(rebuilt.entropy() - blockmodel.entropy()) > 1e-6 * std::abs(rebuilt.entropy())) {
+                ++inconsistent;
+            }
+        }
+        double mean = 0.;
+        for (auto const& S: entropies) {
+            mean += S / double(seeds);
+        }
+        std::cout << (bulk ? "bulk" : threads > 1 ? "async" : "serial") << "  " << threads << "  " << mean << "  " << *std::min_element(entropies.begin(), entropies.end())
+                  << "  " << *std::max_element(entropies.begin(), entropies.end()) << "  "
+                  << double(2 * sweeps * seeds) / seconds << "\n";
+    }
+    std::cout << "inconsistent final states: " << inconsistent << "\n";
+    return inconsistent == 0 ? 0 : 1;
+}
@@ -0,0 +1,139 @@
+/* ~~~~~~~~~~~~~~~~ Notes ~~~~~~~~~~~~~~~~ */
+// Startup / memory benchmark for the partition-count table used by log_q().
+//
+// The lazily grown table in support/int_part.cc is compared against the dense
+// (n_max + 1) x (n_max + 1) table that blockmodel_t used to fill in its
+// constructor. The lazy table is exercised first, through a short annealing
+// run, so that the peak RSS reported for it is not polluted by the dense one.
+//
+// Usage:
+//   bin/q_cache_bench <edge_list_path> <NA> <NB> <KA> <KB> [sweeps]
+
+/* ~~~~~~~~~~~~~~~~ Includes ~~~~~~~~~~~~~~~~ */
+// STL
+#include <iostream>
+#include <chrono>
+#include <random>
+#include <string>
+// POSIX
+#include <sys/resource.h>
+// Boost
+#include <boost/multi_array.hpp>
+// Program headers
+#include "../types.hh"
+#include "../blockmodel.hh"
+#include "../metropolis_hasting.hh"
+#include "../graph_utilities.hh"
+#include "../support/int_part.hh"
+
+using bench_clock_t = std::chrono::steady_clock;
+
+double log_sum(double a, double b);
+
+/* Peak resident set size of the process, in MB. */
+double peak_rss_mb() {
+    struct rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+    return usage.ru_maxrss / 1024. / 1024.;
+#else
+    return usage.ru_maxrss / 1024.;
+#endif
+}
+
+double elapsed_ms(bench_clock_t::time_point since) {
+    return std::chrono::duration<double, std::milli>(bench_clock_t::now() - since).count();
+}
+
+/* The eager table, as it was built by blockmodel_t before the lazy cache. */
+void init_dense_q_cache(boost::multi_array<double, 2>& q_cache, size_t n_max) {
+    q_cache.resize(boost::extents[n_max + 1][n_max + 1]);
+    std::fill(q_cache.data(), q_cache.data() + q_cache.num_elements(),
+              -std::numeric_limits<double>::infinity());
+
+    for (size_t n = 1; n <= n_max; ++n) {
+        q_cache[n][1] = 0;
+        for (size_t k = 2; k <= n; ++k) {
+            q_cache[n][k] = log_sum(q_cache[n][k], q_cache[n][k - 1]);
+            if (n > k)
+                q_cache[n][k] = log_sum(q_cache[n][k], q_cache[n - k][k]);
+        }
+    }
+}
+
+int main(int argc, char const *argv[]) {
+    if (argc < 6) {
+        std::clog << "Usage:\n"
+                  << "  " + std::string(argv[0]) + " <edge_list_path> <NA> <NB> <KA> <KB> [sweeps]\n";
+        return 1;
+    }
+    std::string edge_list_path = argv[1];
+    size_t NA = std::stoul(argv[2]);
+    size_t NB = std::stoul(argv[3]);
+    size_t KA = std::stoul(argv[4]);
+    size_t KB = std::stoul(argv[5]);
+    size_t sweeps = argc > 6 ? std::stoul(argv[6]) : 10;
+
+    edge_list_t edge_list;
+    if (!load_edge_list(edge_list, edge_list_path)) {
+        std::cerr << "Cannot open " << edge_list_path << "\n";
+        return 1;
+    }
+    const csr_graph_t graph(edge_list, NA + NB, NA, NB);
+    edge_list.clear();
+
+    uint_vec_t types(NA + NB, 0);
+    uint_vec_t memberships(NA + NB, 0);
+    for (size_t i = 0; i < NA + NB; ++i) {
+        types[i] = i < NA ? 0 : 1;
+        memberships[i] = i < NA ? unsigned(i * KA / NA) : unsigned(KA + (i - NA) * KB / NB);
+    }
+    double rss_base = peak_rss_mb();
+
+    /* ~~~~~ Lazy table ~~~~~~~*/
+    rng_t engine(42);
+    auto t0 = bench_clock_t::now();
+    blockmodel_t blockmodel(memberships, types, KA + KB, KA, KB, 1., &graph);
+    blockmodel.shuffle_bisbm(engine, NA, NB);
+    double startup_lazy = elapsed_ms(t0);
+    double entropy = blockmodel.entropy();
+
+    metropolis_hasting algorithm;
+    float_vec_t kwargs(1, float(sweeps * (NA + NB)));
+    algorithm.anneal(blockmodel, abrupt_cool_schedule_t(kwargs), sweeps * (NA + NB), sweeps * (NA + NB), engine);
+    double run_lazy = elapsed_ms(t0);
+    double rss_lazy = peak_rss_mb();
+
+    size_t rows = __q_cache_offset.empty() ? 0 : __q_cache_offset.size() - 1;
+    size_t entries = __q_cache.size();
+
+    /* ~~~~~ Dense table ~~~~~~~*/
+    boost::multi_array<double, 2> dense;
+    t0 = bench_clock_t::now();
+    init_dense_q_cache(dense, __q_cache_n_max);
+    double startup_dense = elapsed_ms(t0);
+    double rss_dense = peak_rss_mb();
+
+    // Every lazily materialised entry must agree with the dense table.
+    size_t mismatches = 0;
+    for (size_t n = 0; n < rows; ++n) {
+        for (size_t k = 0; k < __q_cache_offset[n + 1] - __q_cache_offset[n]; ++k) {
+            if (__q_cache[__q_cache_offset[n] + k] != dense[n][k]) {
+                ++mismatches;
+            }
+        }
+    }
+
+    std::cout << "graph: " << edge_list_path << " (N = " << NA + NB << ", E = "
+              << blockmodel.get_num_edges() << ", K = " << KA + KB << ")\n";
+    std::cout << "entropy at start: " << entropy << "\n";
+    std::cout << "lazy  table: " << rows << " rows, k_max = " << __q_cache_k_max << ", " << entries << " entries ("
+              << entries * sizeof(double) / 1024. / 1024. << " MB); startup " << startup_lazy << " ms, "
+              << "startup + " << sweeps << " sweeps " << run_lazy << " ms; peak RSS +" << rss_lazy - rss_base
+              << " MB\n";
+    std::cout << "dense table: " << dense.num_elements() << " entries ("
+              << dense.num_elements() * sizeof(double) / 1024. / 1024. << " MB); startup " << startup_dense
+              << " ms; peak RSS +" << rss_dense - rss_lazy << " MB\n";
+    std::cout << "mismatching entries: " << mismatches << "\n";
+    return mismatches == 0 ? 0 : 1;
+}
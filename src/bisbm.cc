@@ -0,0 +1,489 @@
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <numeric>
+#include <sstream>
+
+#include "bisbm.hh"
+#include "blockmodel.hh"
+#include "checkpoint.hh"
+#include "config.hh"
+#include "cooling_schedules.hh"
+#include "metropolis_hasting.hh"
+#include "support/util.hh"
+
+namespace {
+
+/* Fill in the default arguments of the cooling schedule, or check those given. */
+bool prepare_cooling_schedule(const bisbm_options_t& options, float_vec_t& kwargs, std::ostream& error) {
+    const std::string& cooling_schedule = options.cooling_schedule;
+    size_t sampling_steps = options.sampling_steps;
+    if (cooling_schedule != "exponential" && cooling_schedule != "linear" && cooling_schedule != "logarithmic" &&
+        cooling_schedule != "constant" && cooling_schedule != "abrupt_cool" && cooling_schedule != "adaptive") {
+        error << "Invalid cooling schedule. Options are exponential, linear, logarithmic, constant, abrupt_cool, "
+              << "adaptive.\n";
+        return false;
+    }
+    if (options.cooling_schedule_kwargs.empty()) {
+        kwargs.assign(3, 0);
+        if (cooling_schedule == "exponential") {
+            kwargs[0] = 1;
+            kwargs[1] = 0.99;
+        }
+        if (cooling_schedule == "linear") {
+            kwargs[0] = sampling_steps + 1;
+            kwargs[1] = 1;
+        }
+        if (cooling_schedule == "logarithmic") {
+            kwargs[0] = 1;
+            kwargs[1] = 1;
+        }
+        if (cooling_schedule == "constant") {
+            kwargs[0] = 1;
+        }
+        if (cooling_schedule == "abrupt_cool") {
+            kwargs[0] = options.steps_await;
+        }
+        if (cooling_schedule == "adaptive") {
+            kwargs[0] = 1;
+            kwargs[1] = 0.5;
+            kwargs[2] = 0.95;
+        }
+        return true;
+    }
+    kwargs = options.cooling_schedule_kwargs;
+    size_t num_kwargs = cooling_schedule == "constant" || cooling_schedule == "abrupt_cool" ? 1 :
+                        cooling_schedule == "adaptive" ? 3 : 2;
+    if (kwargs.size() < num_kwargs) {
+        error << "The " << cooling_schedule << " schedule takes " << num_kwargs << " argument(s).\n";
+        return false;
+    }
+    if (cooling_schedule == "exponential") {
+        if (kwargs[0] <= 0) {
+            error << "Invalid cooling schedule argument for linear schedule: T_0 must be grater than 0.\n";
+            error << "Passed value: T_0=" << kwargs[0] << "\n";
+            return false;
+        }
+        if (kwargs[1] <= 0 || kwargs[1] >= 1) {
+            error << "Invalid cooling schedule argument for exponential schedule: alpha must be in ]0,1[.\n";
+            error << "Passed value: alpha=" << kwargs[1] << "\n";
+            return false;
+        }
+    } else if (cooling_schedule == "linear") {
+        if (kwargs[0] <= 0) {
+            error << "Invalid cooling schedule argument for linear schedule: T_0 must be grater than 0.\n";
+            error << "Passed value: T_0=" << kwargs[0] << "\n";
+            return false;
+        }
+        if (kwargs[1] <= 0 || kwargs[1] > kwargs[0]) {
+            error << "Invalid cooling schedule argument for linear schedule: eta must be in ]0, T_0].\n";
+            error << "Passed value: T_0=" << kwargs[0] << ", eta=" << kwargs[1] << "\n";
+            return false;
+        }
+        if (kwargs[1] * sampling_steps > kwargs[0]) {
+            error << "Invalid cooling schedule argument for linear schedule: eta * sampling_steps must be smaller "
+                  << "or equal to T_0.\n";
+            error << "Passed value: eta*sampling_steps=" << kwargs[1] * sampling_steps << ", T_0=" << kwargs[0]
+                  << "\n";
+            return false;
+        }
+    } else if (cooling_schedule == "logarithmic") {
+        if (kwargs[0] <= 0) {
+            error << "Invalid cooling schedule argument for logarithmic schedule: c must be greater than 0.\n";
+            error << "Passed value: c=" << kwargs[0] << "\n";
+            return false;
+        }
+        if (kwargs[1] <= 0) {
+            error << "Invalid cooling schedule argument for logarithmic schedule: d must be greater than 0.\n";
+            error << "Passed value: d=" << kwargs[1] << "\n";
+            return false;
+        }
+    } else if (cooling_schedule == "constant") {
+        if (kwargs[0] <= 0) {
+            error << "Invalid cooling schedule argument for constant schedule: temperature must be greater than 0.\n";
+            error << "Passed value: T=" << kwargs[0] << "\n";
+            return false;
+        }
+    } else if (cooling_schedule == "adaptive") {
+        if (kwargs[0] <= 0) {
+            error << "Invalid cooling schedule argument for adaptive schedule: T_0 must be greater than 0.\n";
+            error << "Passed value: T_0=" << kwargs[0] << "\n";
+            return false;
+        }
+        if (kwargs[1] <= 0 || kwargs[1] >= 1) {
+            error << "Invalid cooling schedule argument for adaptive schedule: r_0 must be in ]0,1[.\n";
+            error << "Passed value: r_0=" << kwargs[1] << "\n";
+            return false;
+        }
+        if (kwargs[2] <= 0 || kwargs[2] > 1) {
+            error << "Invalid cooling schedule argument for adaptive schedule: gamma must be in ]0,1].\n";
+            error << "Passed value: gamma=" << kwargs[2] << "\n";
+            return false;
+        }
+    } else if (kwargs[0] <= 0) {
+        error << "Invalid cooling schedule argument for abrupt_cool schedule: tau must be larger than 0. \n";
+        error << "Passed value: tau=" << kwargs[0] << "\n";
+        return false;
+    }
+    return true;
+}
+
+/* Check the combinations of options; adjusts those that fall back to another mode with a warning. */
+bool check_options(bisbm_options_t& options, std::ostream& error) {
+    bool checkpointing = !options.checkpoint_path.empty() || !options.resume_path.empty();
+    if (options.marginalize) {
+        if (options.merge || options.num_chains > 1 || options.num_replicas > 1 || checkpointing) {
+            error << "--marginalize only applies to a single chain without merges or checkpoints.\n";
+            return false;
+        }
+        if (options.sampling_frequency == 0) {
+            error << "The sampling frequency (-f) must be positive.\n";
+            return false;
+        }
+    }
+    if (options.num_replicas > 1) {
+        if (options.temperatures.size() != 2 || options.temperatures[0] <= 0 ||
+            options.temperatures[1] < options.temperatures[0]) {
+            error << "Invalid temperatures for parallel tempering: expected 0 < T_min <= T_max.\n";
+            return false;
+        }
+        if (options.num_chains > 1) {
+            error << "--chains and --replicas cannot be combined.\n";
+            return false;
+        }
+        if (options.merge) {
+            std::clog << "WARNING: --replicas is not supported with agglomerative merges (-g); annealing instead.\n";
+            options.num_replicas = 0;
+        }
+    }
+    if (checkpointing && (options.merge || options.num_chains > 1 || options.num_replicas > 1)) {
+        error << "--checkpoint and --resume only apply to a single annealing chain without merges.\n";
+        return false;
+    }
+    if (checkpointing && options.cooling_schedule == "adaptive") {
+        error << "--checkpoint and --resume do not support the adaptive schedule, whose state is not saved.\n";
+        return false;
+    }
+    if (options.converge_window > 0) {
+        if (options.converge_window < 20 || options.converge_z <= 0) {
+            error << "The convergence test needs a window of at least 20 sweeps and a positive z.\n";
+            return false;
+        }
+        if (checkpointing) {
+            error << "--checkpoint and --resume do not support the convergence test, whose traces are not saved.\n";
+            return false;
+        }
+    }
+    if (options.merge_split > 0 && (options.num_chains > 1 || options.num_replicas > 1)) {
+        std::clog << "WARNING: --merge_split only applies to a single annealing chain; it is ignored.\n";
+    }
+    if (options.sweep_mode != "async" && options.sweep_mode != "bulk") {
+        error << "Invalid sweep mode. Options are async, bulk.\n";
+        return false;
+    }
+    bool bulk = options.sweep_mode == "bulk";
+    if (options.sweep_threads != 1 || bulk) {
+        if (options.num_chains > 1 || options.num_replicas > 1 || options.marginalize) {
+            std::clog << "WARNING: --sweep_threads and --sweep_mode only apply to the annealing of a single chain; "
+                      << "they are ignored.\n";
+            options.sweep_threads = 1;
+            options.sweep_mode = "async";
+        }
+#if SPARSE_BLOCK_COUNTS
+        if (options.sweep_threads != 1 && !bulk) {
+            std::clog << "WARNING: asynchronous sweeps need the dense block counts (SPARSE_BLOCK_COUNTS=OFF); "
+                      << "running serial sweeps.\n";
+            options.sweep_threads = 1;
+        }
+#endif
+        if (checkpointing && options.sweep_threads != 1 && !bulk) {
+            std::clog << "WARNING: asynchronous sweeps are not reproducible; a resumed run will not be identical "
+                      << "to an uninterrupted one (use --sweep_mode bulk for that).\n";
+        }
+    }
+    if (options.num_chains > 1 && options.merge) {
+        std::clog << "WARNING: --chains is not supported with agglomerative merges (-g); running a single chain.\n";
+        options.num_chains = 1;
+    }
+    return true;
+}
+
+void set_result(const blockmodel_t& blockmodel, bisbm_result_t& result) {
+    result.memberships = *blockmodel.get_memberships();
+    result.KA = blockmodel.get_KA();
+    result.KB = blockmodel.get_KB();
+    result.entropy = blockmodel.entropy();
+}
+
+/* Renumber the non-empty groups of memberships 0, ..., KA - 1 for type a (the first na vertices) and KA,
+ * ..., KA + KB - 1 for type b, keeping their order, and set KA and KB to their numbers. */
+void compact_groups(uint_vec_t& memberships, size_t na, size_t num_groups, size_t& KA, size_t& KB) {
+    std::vector<bool> used(num_groups, false);
+    for (auto const& r: memberships) {
+        used[r] = true;
+    }
+    uint_vec_t label(num_groups, 0);
+    KA = 0;
+    KB = 0;
+    size_t first_b = num_groups;
+    for (size_t v = na; v < memberships.size(); ++v) {
+        first_b = std::min(first_b, size_t(memberships[v]));
+    }
+    for (size_t r = 0; r < num_groups; ++r) {
+        if (used[r]) {
+            label[r] = unsigned(KA + KB);
+            ++(r < first_b ? KA : KB);
+        }
+    }
+    for (auto& r: memberships) {
+        r = label[r];
+    }
+}
+
+}  // namespace
+
+uint_vec_t bisbm_round_robin_memberships(size_t na, size_t nb, size_t KA, size_t KB) {
+    uint_vec_t memberships(na + nb, 0);
+    for (size_t v = 0; v < na; ++v) {
+        memberships[v] = unsigned(v % KA);
+    }
+    for (size_t v = 0; v < nb; ++v) {
+        memberships[na + v] = unsigned(KA + v % KB);
+    }
+    return memberships;
+}
+
+bool bisbm_run(const csr_graph_t& graph, const uint_vec_t& memberships, const bisbm_options_t& run_options,
+               bisbm_result_t& result, std::string& error) {
+    std::ostringstream error_stream;
+    bisbm_options_t options = run_options;
+    float_vec_t cooling_schedule_kwargs;
+    if (!check_options(options, error_stream) ||
+        !prepare_cooling_schedule(options, cooling_schedule_kwargs, error_stream)) {
+        error = error_stream.str();
+        return false;
+    }
+    size_t NA = graph.na();
+    size_t NB = graph.nb();
+    size_t N = graph.num_vertices();
+    size_t KA = options.KA;
+    size_t KB = options.KB;
+    if (NA + NB != N) {
+        error = "Types do not sum to the number of vertices!\n";
+        return false;
+    }
+    if (!options.merge && memberships.size() != N) {
+        error = "The memberships do not cover every vertex of the graph.\n";
+        return false;
+    }
+    uint_vec_t types(N, 0);
+    std::fill(types.begin() + NA, types.end(), 1);
+
+    rng_t engine(options.seed);
+    metropolis_hasting algorithm;
+    algorithm.set_merge_split(options.merge_split, options.merge_split_scans);
+    algorithm.set_convergence(options.converge_window, options.converge_z);
+    algorithm.set_num_threads(options.sweep_threads);
+    algorithm.set_bulk_synchronous(options.sweep_mode == "bulk");
+
+    float_vec_t agg_merge_kwargs;
+    agg_merge_kwargs.resize(1, 0.);
+
+    // blockmodel for the blocks
+    double sigma = 1.01;
+    if (options.merge) {
+        uint_vec_t memberships_init(N, 0);
+        std::iota(memberships_init.begin(), memberships_init.end(), 0);
+        blockmodel_t blockmodel(memberships_init, types, NA + NB, NA, NB, options.epsilon, &graph);
+        memberships_init.clear();
+
+        blockmodel.init_bisbm();
+        if (options.nature) {
+            size_t tKA = NA;
+            size_t tKB = NB;
+            size_t tGroups = NA + NB;
+            size_t num_edges = blockmodel.get_num_edges();
+            size_t ceiling = ceil(sqrt(2 * num_edges) / 2);
+
+            while (tKA >= ceiling && tKB >= ceiling) {
+                blockmodel.agg_merge(engine, ceil(tGroups * (sigma - 1) / sigma), 10);
+                tKA = blockmodel.get_KA();
+                tKB = blockmodel.get_KB();
+
+                tGroups = tKA + tKB;
+                if (options.cooling_schedule != "abrupt_cool") {
+                    error = "Only abrupt cooling annealing is supported.";
+                    return false;
+                }
+                algorithm.anneal(blockmodel, abrupt_cool_schedule_t(agg_merge_kwargs), (NA + NB) * 1,
+                                 options.steps_await, engine);
+            }
+        } else {
+            int_vec_t ka_s;
+            int_vec_t kb_s;
+            std::tie(ka_s, kb_s) = geospace(NA, KA, NB, KB, sigma);
+            for (size_t i = 0; i < ka_s.size() - 1; ++i) {
+                size_t diff_a = -(ka_s[i + 1] - ka_s[i]);
+                size_t diff_b = -(kb_s[i + 1] - kb_s[i]);
+                blockmodel.agg_merge(engine, diff_a, diff_b, 10);
+                if (i != ka_s.size() - 2) {
+                    if (options.cooling_schedule != "abrupt_cool") {
+                        error = "Only abrupt cooling annealing is supported.";
+                        return false;
+                    }
+                    algorithm.anneal(blockmodel, abrupt_cool_schedule_t(agg_merge_kwargs), (NA + NB) * 1,
+                                     options.steps_await, engine);
+                }
+            }
+        }
+
+        result.acceptance_rate = algorithm.anneal(blockmodel, abrupt_cool_schedule_t(cooling_schedule_kwargs),
+                                                  options.sampling_steps, options.steps_await, engine);
+        result.convergence = algorithm.convergence();
+        set_result(blockmodel, result);
+        return true;
+    }
+
+    size_t ka{0};
+    size_t kb{0};
+    for (size_t t = 0; t < NA + NB; ++t) {
+        if (types[t] == 0 && memberships[t] > ka) {
+            ka = memberships[t];
+        } else if (types[t] == 1 && memberships[t] > kb) {
+            kb = memberships[t];
+        }
+    }
+    ka += 1;
+    // Groups 0, ..., ka - 1 are those of type a and ka, ..., kb those of type b. A type-b vertex in a
+    // group of type a would otherwise pass unnoticed, or make kb wrap around.
+    for (size_t t = NA; t < NA + NB; ++t) {
+        if (memberships[t] < ka) {
+            error = "Vertex " + std::to_string(t) + " is of type b but in group " + std::to_string(memberships[t])
+                    + "; the groups of type b must be numbered after those of type a (from "
+                    + std::to_string(ka) + ").\n";
+            return false;
+        }
+    }
+    kb = kb + 1 - ka;  // from the largest label of type b to the number of groups of type b
+    int diff_a = ka - KA;
+    int diff_b = kb - KB;
+    if (diff_a != 0 || diff_b != 0) {
+        if (options.marginalize) {
+            error = "--marginalize needs (Ka, Kb) to match the initial memberships.\n";
+            return false;
+        }
+        if (options.num_chains > 1 || options.num_replicas > 1) {
+            std::clog << "WARNING: --chains and --replicas are not supported when (Ka, Kb) differ from the "
+                      << "initial memberships; running a single chain.\n";
+        }
+        blockmodel_t blockmodel(memberships, types, ka + kb, ka, kb, options.epsilon, &graph);
+        blockmodel.init_bisbm();
+        blockmodel.set_num_threads(options.num_threads);
+        if (diff_a >= 0 && diff_b >= 0) {
+            int_vec_t ka_s;
+            int_vec_t kb_s;
+            std::tie(ka_s, kb_s) = geospace(KA + diff_a, KA, KB + diff_b, KB, sigma);
+            if (ka_s.size() == 1) {
+                blockmodel.agg_merge(engine, diff_a, diff_b, 10);
+            }
+            for (size_t i = 0; i < ka_s.size() - 1; ++i) {
+                diff_a = -(ka_s[i + 1] - ka_s[i]);
+                diff_b = -(kb_s[i + 1] - kb_s[i]);
+                blockmodel.agg_merge(engine, diff_a, diff_b, 10);
+                if (i != ka_s.size() - 2) {
+                    if (options.cooling_schedule != "abrupt_cool") {
+                        error = "Only abrupt cooling annealing is supported.";
+                        return false;
+                    }
+                    algorithm.anneal(blockmodel, abrupt_cool_schedule_t(agg_merge_kwargs), (NA + NB) * 1,
+                                     options.steps_await, engine);
+                }
+            }
+        } else {
+            blockmodel.agg_merge(engine, diff_a, diff_b, 100);
+        }
+        result.acceptance_rate = algorithm.anneal(blockmodel, abrupt_cool_schedule_t(cooling_schedule_kwargs),
+                                                  options.sampling_steps, options.steps_await, engine);
+        result.convergence = algorithm.convergence();
+        set_result(blockmodel, result);
+        return true;
+    }
+
+    if (options.num_replicas > 1) {
+        result.tempering = run_tempering(
+                memberships, types, NA, NB, KA, KB, options.epsilon, &graph, options.randomize,
+                geometric_ladder(options.temperatures[0], options.temperatures[1], options.num_replicas),
+                options.sampling_steps, options.swap_interval, options.seed, options.num_threads);
+        result.memberships = result.tempering.memberships;
+        result.KA = result.tempering.KA;
+        result.KB = result.tempering.KB;
+        result.entropy = result.tempering.entropy;
+        return true;
+    }
+    if (options.num_chains > 1) {
+        result.chains = run_chains(
+                memberships, types, NA, NB, KA, KB, options.epsilon, &graph, options.randomize,
+                options.cooling_schedule, cooling_schedule_kwargs, options.sampling_steps, options.steps_await,
+                options.converge_window, options.converge_z, options.seed, options.num_chains, options.num_threads);
+        size_t best = 0;
+        for (size_t i = 0; i < result.chains.size(); ++i) {
+            if (result.chains[i].entropy < result.chains[best].entropy) {
+                best = i;
+            }
+        }
+        result.best_chain = best;
+        result.memberships = result.chains[best].memberships;
+        result.KA = result.chains[best].KA;
+        result.KB = result.chains[best].KB;
+        result.entropy = result.chains[best].entropy;
+        return true;
+    }
+
+    blockmodel_t blockmodel(memberships, types, KA + KB, KA, KB, options.epsilon, &graph);
+    if (!options.resume_path.empty()) {
+        checkpoint_t checkpoint;
+        if (!load_checkpoint(checkpoint, options.resume_path)) {
+            error = "Cannot load checkpoint " + options.resume_path + "\n";
+            return false;
+        }
+        if (!checkpoint_fits(checkpoint, NA, NB, KA, KB)) {
+            error = "Checkpoint " + options.resume_path + " does not match the graph or (Ka, Kb).\n";
+            return false;
+        }
+        if (!blockmodel.restore(checkpoint.memberships, checkpoint.vlist, checkpoint.entropy)) {
+            error = "Checkpoint " + options.resume_path + " is corrupt: its entropy does not match its memberships.\n";
+            return false;
+        }
+        engine = checkpoint.engine;
+        algorithm.resume_from(checkpoint);
+        std::clog << "Resuming from sweep " << checkpoint.sweep << " of " << options.resume_path << "\n";
+    } else if (options.randomize) {
+        blockmodel.shuffle_bisbm(engine, NA, NB);
+    } else {
+        blockmodel.init_bisbm();
+    }
+    if (!options.checkpoint_path.empty()) {
+        algorithm.set_checkpoint(options.checkpoint_path, options.checkpoint_every);
+    }
+    if (options.marginalize) {
+        result.acceptance_rate = algorithm.marginalize(blockmodel, options.burn_in, options.sampling_steps,
+                                                       options.sampling_frequency, result.marginals, engine);
+        // Report the max-marginal partition, not the last sample: its own entropy, and (Ka, Kb) without the
+        // groups it leaves empty.
+        size_t max_KA;
+        size_t max_KB;
+        uint_vec_t max_marginal = result.marginals.max_marginal();
+        compact_groups(max_marginal, NA, KA + KB, max_KA, max_KB);
+        blockmodel_t summary(max_marginal, types, max_KA + max_KB, max_KA, max_KB, options.epsilon, &graph);
+        summary.init_bisbm();
+        set_result(summary, result);
+    } else {
+        with_cooling_schedule(options.cooling_schedule, cooling_schedule_kwargs, [&](auto schedule) {
+            result.acceptance_rate = algorithm.anneal(blockmodel, schedule, options.sampling_steps,
+                                                      options.steps_await, engine);
+        });
+        result.convergence = algorithm.convergence();
+        set_result(blockmodel, result);
+    }
+    return true;
+}
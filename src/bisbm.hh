@@ -0,0 +1,82 @@
+#ifndef BISBM_HH
+#define BISBM_HH
+
+#include <string>
+#include <vector>
+#include "types.hh"
+#include "csr_graph.hh"
+#include "chains.hh"
+#include "convergence.hh"
+#include "marginals.hh"
+#include "tempering.hh"
+
+/* In-memory interface of libbisbm.
+ *
+ * bisbm_run fits the bipartite SBM to a graph that is already in memory, as a csr_graph_t built
+ * from an edge list, an adjacency list or borrowed CSR arrays, and returns the memberships and
+ * the description length directly. bin/mcmc is a command-line client of this function: every
+ * option below matches the command-line option of the same name. */
+
+struct bisbm_options_t {
+    size_t KA{0};  // number of groups of each type to infer
+    size_t KB{0};
+    double epsilon{1.};
+
+    std::string cooling_schedule{"abrupt_cool"};  // exponential, linear, logarithmic, constant, abrupt_cool, adaptive
+    float_vec_t cooling_schedule_kwargs;          // empty: the defaults of the schedule
+    size_t sampling_steps{1000};                  // length of the annealing, in vertex moves
+    size_t steps_await{1000};
+    size_t converge_window{0};                    // sweeps of the convergence test; 0: steps_await only
+    double converge_z{2.};                        // largest |z| of a stabilised chain
+    size_t seed{0};
+    bool randomize{false};                        // shuffle the initial memberships within each type
+
+    bool merge{false};   // start from one group per vertex and merge agglomeratively (-g)
+    bool nature{false};  // with merge, stop merging at sqrt(2E) / 2 groups per type instead of (KA, KB)
+
+    size_t num_chains{1};
+    size_t num_threads{0};  // for chains, replicas or agg_split; 0: one per hardware core
+    size_t sweep_threads{1};  // threads of each sweep of a single chain; 0: one per hardware core
+    std::string sweep_mode{"async"};  // async (used above 1 thread) or bulk (bulk-synchronous, for any thread count)
+    size_t num_replicas{0};
+    float_vec_t temperatures{1, 2};  // T_min and T_max of the tempering ladder
+    size_t swap_interval{1};
+
+    size_t merge_split{0};
+    size_t merge_split_scans{0};
+
+    bool marginalize{false};  // sample the posterior instead of annealing; counts below are in sweeps
+    size_t burn_in{1000};
+    size_t sampling_frequency{10};
+
+    std::string checkpoint_path;
+    size_t checkpoint_every{100};
+    std::string resume_path;
+};
+
+struct bisbm_result_t {
+    uint_vec_t memberships;  // final state; the best chain, the best tempering state or the max-marginal partition
+    size_t KA{0};            // of memberships; the max-marginal partition is renumbered without its empty groups
+    size_t KB{0};
+    double entropy{0.};          // description length of memberships
+    double acceptance_rate{0.};  // of the last annealing or sampling run; not set for chains and replicas
+    convergence_t convergence;   // of the last annealing run; not set for chains, replicas and marginalize
+
+    std::vector<chain_result_t> chains;  // with num_chains > 1, in chain order
+    size_t best_chain{0};
+    tempering_result_t tempering;        // with num_replicas > 1
+    marginals_t marginals;               // with marginalize
+};
+
+/* Initial memberships with every vertex of type a in group v % KA and every vertex of type b in
+ * group KA + v % KB. */
+uint_vec_t bisbm_round_robin_memberships(size_t na, size_t nb, size_t KA, size_t KB);
+
+/* Run the sampler on graph, whose first graph.na() vertices are of type a, starting from
+ * memberships (ignored with options.merge), in which the groups of type a are numbered 0, ..., ka - 1
+ * and those of type b ka, ..., ka + kb - 1. Returns true on success; otherwise error describes
+ * the problem. Information and warnings are written to std::clog. */
+bool bisbm_run(const csr_graph_t& graph, const uint_vec_t& memberships, const bisbm_options_t& options,
+               bisbm_result_t& result, std::string& error);
+
+#endif // BISBM_HH
@@ -0,0 +1,103 @@
+#ifndef BLOCK_COUNTS_HH
+#define BLOCK_COUNTS_HH
+
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include "types.hh"
+#include "config.hh"
+#include "support/atomic_ops.hh"
+
+/* Number of neighbours of a vertex in each block, i.e. one row of k_.
+ *
+ * Two interchangeable layouts are provided. The dense one stores all K
+ * entries and is the fastest when K is small; the sparse one stores only the
+ * non-zero entries, sorted by block, so that memory and iteration cost scale
+ * with the degree of the vertex instead of with K. The layout is chosen at
+ * build time with the SPARSE_BLOCK_COUNTS CMake option. Only the dense layout
+ * can be updated atomically, so asynchronous sweeps need it. */
+
+class dense_block_counts_t {
+public:
+    void clear(size_t num_blocks) noexcept { counts_.assign(num_blocks, 0); }
+
+    inline int operator[](size_t r) const noexcept { return counts_[r]; }
+
+    inline void add(size_t r, int delta) noexcept { counts_[r] += delta; }
+
+    /* add(), safe against concurrent updates of the same row by the threads of an asynchronous sweep. */
+    inline void add_atomic(size_t r, int delta) noexcept { atomic_add(counts_[r], delta); }
+
+    /* operator[], safe against concurrent add_atomic() calls. */
+    inline int load_atomic(size_t r) const noexcept { return atomic_load(counts_[r]); }
+
+    /* All K counts, contiguous; used by the vectorized transition_ratio kernel. */
+    inline const int* data() const noexcept { return counts_.data(); }
+
+    /* Call f(r, count) for every block r with a non-zero count, in increasing order of r. */
+    template <class F>
+    inline void for_each(F &&f) const noexcept {
+        for (size_t r = 0; r < counts_.size(); ++r) {
+            if (counts_[r] != 0) {
+                f(r, counts_[r]);
+            }
+        }
+    }
+
+private:
+    int_vec_t counts_;
+};
+
+class sparse_block_counts_t {
+public:
+    void clear(size_t) noexcept { entries_.clear(); }
+
+    inline int operator[](size_t r) const noexcept {
+        auto it = lower_bound(r);
+        return (it != entries_.end() && it->first == r) ? it->second : 0;
+    }
+
+    inline void add(size_t r, int delta) noexcept {
+        auto it = lower_bound(r);
+        if (it != entries_.end() && it->first == r) {
+            it->second += delta;
+            if (it->second == 0) {
+                entries_.erase(it);
+            }
+        } else if (delta != 0) {
+            entries_.insert(it, std::make_pair(unsigned(r), delta));
+        }
+    }
+
+    /* Call f(r, count) for every block r with a non-zero count, in increasing order of r. */
+    template <class F>
+    inline void for_each(F &&f) const noexcept {
+        for (auto const &e: entries_) {
+            f(size_t(e.first), e.second);
+        }
+    }
+
+private:
+    using entry_t = std::pair<unsigned int, int>;
+    std::vector<entry_t> entries_;
+
+    inline std::vector<entry_t>::iterator lower_bound(size_t r) noexcept {
+        return std::lower_bound(entries_.begin(), entries_.end(), r,
+                                [](const entry_t &e, size_t b) { return e.first < b; });
+    }
+
+    inline std::vector<entry_t>::const_iterator lower_bound(size_t r) const noexcept {
+        return std::lower_bound(entries_.begin(), entries_.end(), r,
+                                [](const entry_t &e, size_t b) { return e.first < b; });
+    }
+};
+
+#if SPARSE_BLOCK_COUNTS
+using block_counts_t = sparse_block_counts_t;
+#else
+using block_counts_t = dense_block_counts_t;
+#endif
+
+using block_counts_vec_t = std::vector<block_counts_t>;
+
+#endif // BLOCK_COUNTS_HH
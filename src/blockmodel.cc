@@ -1,10 +1,14 @@
+#include <cmath>
 #include <iostream>
 
 
 #include "blockmodel.hh"
 #include "graph_utilities.hh"  // for the is_disjoint function
 #include "output_functions.hh"
+#include "perf_counters.hh"
+#include "chains.hh"  // for parallel_for
 
+#include "support/atomic_ops.hh"
 #include "support/cache.hh"
 #include "support/int_part.hh"
 #include "support/util.hh"
@@ -13,8 +17,8 @@ using namespace std;
 
 /** Default constructor */
 blockmodel_t::blockmodel_t(const uint_vec_t &memberships, uint_vec_t types, size_t g, size_t KA,
-                           size_t KB, double epsilon, const adj_list_t *adj_list_ptr) :
-        adj_list_ptr_(adj_list_ptr),
+                           size_t KB, double epsilon, const csr_graph_t *graph) :
+        graph_(graph),
         types_(std::move(types)) {
     KA_ = KA;
     KB_ = KB;
@@ -24,8 +28,9 @@ blockmodel_t::blockmodel_t(const uint_vec_t &memberships, uint_vec_t types, size
     deg_.resize(memberships.size(), 0);
     vlist_.resize(memberships.size(), 0);
     blist_.resize(memberships.size(), 0);
-    num_edges_ = 0;
+    num_edges_ = graph_->num_edges();
     entropy_from_degree_correction_ = 0.;
+    entropy_from_multi_edges_ = 0.;
 
     for (size_t j = 0; j < memberships.size(); ++j) {
         if (types_[j] == 0) {
@@ -33,19 +38,13 @@ blockmodel_t::blockmodel_t(const uint_vec_t &memberships, uint_vec_t types, size
         } else if (types_[j] == 1) {
             nb_ += 1;
         }
-
-        for (auto nb = adj_list_ptr_->at(j).begin(); nb != adj_list_ptr_->at(j).end(); ++nb) {
-            ++deg_[j];
-            ++num_edges_;
-        }
+        deg_[j] = int(graph_->degree(j));
         vlist_[j] = j;
     }
-    num_edges_ /= 2;
     max_degree_ = *max_element(deg_.begin(), deg_.end());
 
     // initiate caches
     init_cache(num_edges_);
-    init_q_cache(10000);
 
     double deg_factorial = 0;
     for (size_t node = 0; node < memberships.size(); ++node) {
@@ -57,24 +56,26 @@ blockmodel_t::blockmodel_t(const uint_vec_t &memberships, uint_vec_t types, size
         entropy_from_degree_correction_ += deg_factorial;
     }
 
-    // Note that Tiago's MCMC proposal jumps has to randomly access elements in an adjacency list
-    // Here, we define an vectorized data structure to make such data access O(1) [else it'll be O(n)].
-    adj_list_.resize(adj_list_ptr_->size());
-    adj_map_.resize(adj_list_ptr_->size());
-    for (size_t i = 0; i < adj_list_ptr_->size(); ++i) {
-        adj_list_[i].resize(adj_list_ptr_->at(i).size(), 0);
-    }
-    for (size_t node = 0; node < memberships_.size(); ++node) {
-        size_t idx = 0;
-        for (auto nb = adj_list_ptr_->at(node).begin(); nb != adj_list_ptr_->at(node).end(); ++nb) {
-            adj_list_[node][idx] = size_t(*nb);
-            ++adj_map_[node][*nb];
-            ++idx;
+    // The multi-edge term sum_{i>j} log(m_ij!) depends only on the graph, so it is computed once here
+    // by sorting each neighbour list and counting runs of equal neighbours.
+    std::vector<uint32_t> nbs;
+    for (size_t node = 0; node < graph_->num_vertices(); ++node) {
+        nbs.assign(graph_->begin(node), graph_->end(node));
+        sort(nbs.begin(), nbs.end());
+        for (size_t i = 0; i < nbs.size();) {
+            size_t j = i + 1;
+            while (j < nbs.size() && nbs[j] == nbs[i]) {
+                ++j;
+            }
+            if (j - i > 1 && node > nbs[i]) {
+                entropy_from_multi_edges_ += lgamma_fast(int(j - i) + 1);  // sum_m_ij (sum_m_ii is always 0)
+            }
+            i = j;
         }
     }
 }
 
-const int_vec_t *blockmodel_t::get_k(size_t vertex) const noexcept { return &k_[vertex]; }
+const block_counts_t *blockmodel_t::get_k(size_t vertex) const noexcept { return &k_[vertex]; }
 
 int blockmodel_t::get_degree(size_t vertex) const noexcept { return deg_.at(vertex); }
 
@@ -88,8 +89,6 @@ const uint_vec_t *blockmodel_t::get_memberships() const noexcept { return &membe
 
 double blockmodel_t::get_epsilon() const noexcept { return epsilon_; }
 
-double blockmodel_t::get_entropy() const noexcept { return entropy_; }
-
 const int_mat_t *blockmodel_t::get_m() const noexcept { return &m_; }
 
 const int_vec_t *blockmodel_t::get_m_r() const noexcept { return &m_r_; }
@@ -98,6 +97,8 @@ const uint_mat_t *blockmodel_t::get_eta_rk_() const noexcept { return &eta_rk_;
 
 const int_vec_t *blockmodel_t::get_n_r() const noexcept { return &n_r_; }
 
+const uint_vec_t &blockmodel_t::get_members(size_t r) const noexcept { return members_[r]; }
+
 inline size_t blockmodel_t::get_g() const noexcept { return K_; }
 
 size_t blockmodel_t::get_KA() const noexcept { return KA_; }
@@ -106,7 +107,10 @@ size_t blockmodel_t::get_KB() const noexcept { return KB_; }
 
 uint_vec_t &blockmodel_t::get_vlist() noexcept { return vlist_; }
 
-void blockmodel_t::agg_merge(mt19937 &engine, int diff_a, int diff_b, int nm) noexcept {
+void blockmodel_t::set_num_threads(size_t num_threads) noexcept { num_threads_ = num_threads; }
+
+void blockmodel_t::agg_merge(rng_t &engine, int diff_a, int diff_b, int nm) noexcept {
+    PERF_TIMER(agg_merge);
     while (diff_a < 0) {
         agg_split(engine, false, nm);
         diff_a++;
@@ -130,134 +134,53 @@ void blockmodel_t::agg_merge(mt19937 &engine, int diff_a, int diff_b, int nm) no
         iota(blist_.begin(), blist_.end(), 0);
     }
 
-    bmoves_.clear();
-    bmoves_.resize(nm * blist_.size());
-
     compute_b_adj_list();
     priority_queue<pi, vector<pi>, greater<> > q;
-    set<string> set_str_;
-    string identifier_;
-    size_t ii{0};
-    set<size_t> set_e;
-    block_move_t mv;
-    accepted_set_vec_.clear();
-    q = priority_queue<pi, vector<pi>, greater<> >();
-    set_str_.clear();
-    ii = 0;
-    for (auto const &v: blist_) {
-        for (size_t i_ = 0; i_ < nm; ++i_) {
-            bmove_ = single_block_change(engine, v);
-            identifier_ = to_string(bmove_.source) + ">" + to_string(bmove_.target);
-            if (set_str_.count(identifier_) == 0) {
-                bmoves_[ii] = bmove_;
-                double dS = compute_dS(bmove_);
-                q.push(make_pair(dS, ii));
-                set_str_.insert(identifier_);
-                ++ii;
-            }
-        }
-    }
-    set_e.clear();
+    propose_block_merges(engine, nm, q);
+    merged_blocks_.reset(K_);
     bool recursive = false;
     while (diff_a + diff_b != 0 && !q.empty()) {
         if (q.top().first == numeric_limits<double>::infinity()) {
-            apply_block_moves(set_e, accepted_set_vec_);
+            apply_block_moves();
             agg_merge(engine, diff_a, diff_b, nm);
             recursive = true;
             break;
         }
-        mv = bmoves_[q.top().second];
+        const block_move_t& mv = bmoves_[q.top().second];
         if (mv.source < KA_ && diff_a != 0) {
-            if (!(set_e.count(mv.source) > 0 && set_e.count(mv.target) > 0)) {
+            if (accept_block_merge(mv)) {
                 diff_a -= 1;
-                if (set_e.count(mv.source) == 0 && set_e.count(mv.target) == 0) {
-                    accepted_set_vec_.push_back({mv.source, mv.target});
-                } else {
-                    for (auto &_s: accepted_set_vec_) {
-                        if (_s.count(mv.target) > 0 || _s.count(mv.source) > 0) {
-                            _s.insert({mv.source, mv.target});
-                            break;
-                        }
-                    }
-                }
-                set_e.insert({mv.source, mv.target});
             }
         } else if (mv.source >= KA_ && diff_b != 0) {
-            if (!(set_e.count(mv.source) > 0 && set_e.count(mv.target) > 0)) {
+            if (accept_block_merge(mv)) {
                 diff_b -= 1;
-                if (set_e.count(mv.source) == 0 && set_e.count(mv.target) == 0) {
-                    accepted_set_vec_.push_back({mv.source, mv.target});
-                } else {
-                    for (auto &_s: accepted_set_vec_) {
-                        if (_s.count(mv.target) > 0 || _s.count(mv.source) > 0) {
-                            _s.insert({mv.source, mv.target});
-                            break;
-                        }
-                    }
-                }
-                set_e.insert({mv.source, mv.target});
             }
         }
         q.pop();
     }
     if (!recursive) {
-        apply_block_moves(set_e, accepted_set_vec_);
+        apply_block_moves();
     }
 }
 
-void blockmodel_t::agg_merge(mt19937 &engine, int diff, int nm) noexcept {
+void blockmodel_t::agg_merge(rng_t &engine, int diff, int nm) noexcept {
+    PERF_TIMER(agg_merge);
     if (diff == 0) {
         return;
     }
     blist_.resize(K_, 0);
     iota(blist_.begin(), blist_.end(), 0);
 
-    bmoves_.clear();
-    bmoves_.resize(nm * blist_.size());
-
     compute_b_adj_list();
     priority_queue<pi, vector<pi>, greater<> > q;
-    set<string> set_str_;
-    string identifier_;
-    size_t ii{0};
-    set<size_t> set_e;
-    block_move_t mv;
     const int DIFF = diff;
     bool minS{true};
     while (minS) {
-        accepted_set_vec_.clear();
-        q = priority_queue<pi, vector<pi>, greater<> >();
-        set_str_.clear();
-        ii = 0;
-        for (auto const &v: blist_) {
-            for (size_t i_ = 0; i_ < nm; ++i_) {
-                bmove_ = single_block_change(engine, v);
-                identifier_ = to_string(bmove_.source) + ">" + to_string(bmove_.target);
-                if (set_str_.count(identifier_) == 0) {
-                    bmoves_[ii] = bmove_;
-                    double dS = compute_dS(bmove_);
-                    q.push(make_pair(dS, ii));
-                    set_str_.insert(identifier_);
-                    ++ii;
-                }
-            }
-        }
-        set_e.clear();
+        propose_block_merges(engine, nm, q);
+        merged_blocks_.reset(K_);
         while (diff != 0 && !q.empty()) {
-            mv = bmoves_[q.top().second];
-            if (!(set_e.count(mv.source) > 0 && set_e.count(mv.target) > 0)) {
+            if (accept_block_merge(bmoves_[q.top().second])) {
                 diff -= 1;
-                if (set_e.count(mv.source) == 0 && set_e.count(mv.target) == 0) {
-                    accepted_set_vec_.push_back({mv.source, mv.target});
-                } else {
-                    for (auto &_s: accepted_set_vec_) {
-                        if (_s.count(mv.target) > 0 || _s.count(mv.source) > 0) {
-                            _s.insert({mv.source, mv.target});
-                            break;
-                        }
-                    }
-                }
-                set_e.insert({mv.source, mv.target});
             }
             minS = false;
             if (q.top().first == numeric_limits<double>::infinity()) {
@@ -267,23 +190,68 @@ void blockmodel_t::agg_merge(mt19937 &engine, int diff, int nm) noexcept {
         }
         diff = DIFF;
     }
-    apply_block_moves(set_e, accepted_set_vec_);
+    apply_block_moves();
+}
+
+inline void blockmodel_t::propose_block_merges(rng_t &engine, int nm,
+                                               priority_queue<pi, vector<pi>, greater<> >& q) noexcept {
+    q = priority_queue<pi, vector<pi>, greater<> >();
+    bmoves_.clear();
+    bmoves_.reserve(nm * blist_.size());
+    proposed_.clear();
+    proposed_.reserve(nm * blist_.size());
+    for (auto const &v: blist_) {
+        for (size_t i_ = 0; i_ < nm; ++i_) {
+            bmove_ = single_block_change(engine, v);
+            // source >= target, so that each unordered pair of blocks has a single key
+            if (proposed_.insert(bmove_.source * K_ + bmove_.target).second) {
+                q.push(make_pair(compute_dS(bmove_), bmoves_.size()));
+                bmoves_.push_back(bmove_);
+            }
+        }
+    }
 }
 
+inline bool blockmodel_t::accept_block_merge(const block_move_t& move) noexcept {
+    // a block joins at most one group per round: two blocks that are both merged already are left apart
+    if (merged_blocks_.merged(move.source) && merged_blocks_.merged(move.target)) {
+        return false;
+    }
+    merged_blocks_.unite(move.source, move.target);
+    return true;
+}
 
 inline void blockmodel_t::compute_b_adj_list() noexcept {
+    // b_adj_list_[r] lists, in increasing order, the blocks sharing at least one edge with r; it is
+    // gathered from the edges of the members of r (bucketed by block), in O(N + E) instead of O(K^2)
+    size_t N = memberships_.size();
+    uint_vec_t start(K_ + 1, 0);
+    for (auto const &mb: memberships_) {
+        ++start[mb + 1];
+    }
+    for (size_t r = 0; r < K_; ++r) {
+        start[r + 1] += start[r];
+    }
+    uint_vec_t members(N);
+    uint_vec_t next(start.begin(), start.end() - 1);
+    for (size_t v = 0; v < N; ++v) {
+        members[next[memberships_[v]]++] = unsigned(v);
+    }
+    std::vector<size_t> seen(K_, K_);
     b_adj_list_.resize(K_);
-    for (size_t i = 0; i < K_; ++i) {
-        b_adj_list_[i].resize(count_if(m_[i].begin(), m_[i].end(), [](int i) { return i > 0; }), 0);
-    }
-    for (size_t node = 0; node < K_; ++node) {
-        size_t idx = 0;
-        for (size_t mb = 0; mb < K_; ++mb) {
-            if (m_[node][mb] > 0) {
-                b_adj_list_[node][idx] = mb;
-                ++idx;
+    for (size_t r = 0; r < K_; ++r) {
+        auto &adj = b_adj_list_[r];
+        adj.clear();
+        for (size_t i = start[r]; i < start[r + 1]; ++i) {
+            for (auto it = graph_->begin(members[i]); it != graph_->end(members[i]); ++it) {
+                size_t s = memberships_[*it];
+                if (seen[s] != r) {
+                    seen[s] = r;
+                    adj.push_back(s);
+                }
             }
         }
+        sort(adj.begin(), adj.end());
     }
 }
 
@@ -298,12 +266,11 @@ double blockmodel_t::compute_dS(mcmc_move_t &move) noexcept {
     double entropy0 = 0.;
     double entropy1 = 0.;
 
-    int_vec_t ki = k_[v_];
+    const block_counts_t &ki = k_[v_];
     int deg = deg_.at(v_);
 
-    auto citer_padded_m0 = m_r_.begin();
-    auto citer_m0_r = m_.at(r_).begin();
-    auto citer_m0_s = m_.at(s_).begin();
+    const int_vec_t &m0_r = m_.at(r_);
+    const int_vec_t &m0_s = m_.at(s_);
 
     int INT_padded_m0r = m_r_.at(r_);
     int INT_padded_m1r = INT_padded_m0r - deg;
@@ -312,18 +279,14 @@ double blockmodel_t::compute_dS(mcmc_move_t &move) noexcept {
     int INT_padded_m1s = INT_padded_m0s + deg;
 
     auto criterion = (r_ < KA_) ? [](size_t a, size_t k) { return a >= k; } : [](size_t a, size_t k) { return a < k; };
-    for (auto const &_k: ki) {
-        size_t index = &_k - &ki.at(0);
-        if (criterion(index, KA_) && _k != 0) {
-            entropy0 -= lgamma_fast(*citer_m0_r + 1);
-            entropy0 -= lgamma_fast(*citer_m0_s + 1);
-            entropy1 -= lgamma_fast(*citer_m0_r - _k + 1);
-            entropy1 -= lgamma_fast(*citer_m0_s + _k + 1);
+    ki.for_each([&](size_t index, int _k) {
+        if (criterion(index, KA_)) {
+            entropy0 -= lgamma_fast(m0_r[index] + 1);
+            entropy0 -= lgamma_fast(m0_s[index] + 1);
+            entropy1 -= lgamma_fast(m0_r[index] - _k + 1);
+            entropy1 -= lgamma_fast(m0_s[index] + _k + 1);
         }
-        ++citer_m0_s;
-        ++citer_padded_m0;
-        ++citer_m0_r;
-    }
+    });
     entropy0 -= -lgamma_fast(INT_padded_m0r + 1);
     entropy0 -= -lgamma_fast(INT_padded_m0s + 1);
     entropy1 -= -lgamma_fast(INT_padded_m1r + 1);
@@ -332,7 +295,7 @@ double blockmodel_t::compute_dS(mcmc_move_t &move) noexcept {
     return entropy1 - entropy0;
 }
 
-inline double blockmodel_t::compute_dS(const block_move_t& move) noexcept {
+double blockmodel_t::compute_dS(const block_move_t& move) noexcept {
     size_t r_ = move.source;
     size_t s_ = move.target;
 
@@ -371,7 +334,7 @@ inline double blockmodel_t::compute_dS(const block_move_t& move) noexcept {
     return entropy1 - entropy0;
 }
 
-inline double blockmodel_t::compute_dS(size_t mb, vector<bool>& split_move) noexcept {
+double blockmodel_t::compute_dS(size_t mb, vector<bool>& split_move) noexcept {
     if (split_move.empty()) {
         return numeric_limits<double>::infinity();
     }
@@ -386,20 +349,18 @@ inline double blockmodel_t::compute_dS(size_t mb, vector<bool>& split_move) noex
     uint_vec_t k;
     k.resize(n_r_.size(), 0);
 
-    size_t order{0};
     size_t deg{0};
-    for (auto const &_mb: memberships_) {
-        size_t node_id = &_mb - &memberships_.at(0);
-        if (_mb == r_) {
-            for (auto const &_k: k_[node_id]) {
-                size_t __k = &_k - &k_[node_id].at(0);
-                if (criterion(__k, KA_) && split_move[order]) {
-                    k.at(__k) += _k;
-                    deg += _k;
-                }
-            }
+    const auto &members = members_[r_];
+    for (size_t order = 0; order < members.size(); ++order) {
+        if (!split_move[order]) {
+            continue;
         }
-        order++;
+        k_[members[order]].for_each([&](size_t __k, int _k) {
+            if (criterion(__k, KA_)) {
+                k[__k] += _k;
+                deg += _k;
+            }
+        });
     }
 
     auto citer_m0_r = m_.at(r_).begin();
@@ -423,7 +384,7 @@ inline double blockmodel_t::compute_dS(size_t mb, vector<bool>& split_move) noex
     return entropy1 - entropy0;
 }
 
-vector<vector<size_t> > &blockmodel_t::get_adj_list() noexcept { return adj_list_; }
+const csr_graph_t &blockmodel_t::get_graph() const noexcept { return *graph_; }
 
 void blockmodel_t::apply_split_moves(const vector<mcmc_move_t>& moves) noexcept {
     bool rearranged = false;
@@ -452,10 +413,12 @@ void blockmodel_t::apply_split_moves(const vector<mcmc_move_t>& moves) noexcept
     }
     ++K_;
     compute_n_r();
+    compute_members();
     compute_k();
     compute_m();
     compute_m_r();
     compute_eta_rk();
+    entropy_ = compute_entropy();
 }
 
 bool blockmodel_t::apply_mcmc_moves(const vector<mcmc_move_t> &moves, double dS) noexcept {
@@ -467,31 +430,41 @@ bool blockmodel_t::apply_mcmc_moves(const vector<mcmc_move_t> &moves, double dS)
         --n_r_[__source__];
         if (n_r_[__source__] == 0) {  // No move that makes an empty group will be allowed
             ++n_r_[__source__];
+            PERF_COUNT(rejected_empty_group);
             return false;
         }
         ++n_r_[__target__];
 
+        // Swap the vertex out of the member list of the source, onto the end of the target's
+        auto &source_members = members_[__source__];
+        size_t last = source_members.back();
+        source_members[member_index_[__vertex__]] = unsigned(last);
+        member_index_[last] = member_index_[__vertex__];
+        source_members.pop_back();
+        member_index_[__vertex__] = unsigned(members_[__target__].size());
+        members_[__target__].push_back(unsigned(__vertex__));
+
         --eta_rk_[__source__][deg_[__vertex__]];
         ++eta_rk_[__target__][deg_[__vertex__]];
 
         ki_ = get_k(__vertex__);
-        size_t ki_size = ki_->size();
-        for (size_t i = 0; i < ki_size; ++i) {
-            int ki_at_i = ki_->at(i);
-            if (ki_at_i != 0) {
-                m_[__source__][i] -= ki_at_i;
-                m_[__target__][i] += ki_at_i;
-                m_[i][__source__] = m_[__source__][i];
-                m_[i][__target__] = m_[__target__][i];
-            }
-        }
+        ki_->for_each([this](size_t i, int ki_at_i) {
+            m_[__source__][i] -= ki_at_i;
+            m_[__target__][i] += ki_at_i;
+            m_[i][__source__] = m_[__source__][i];
+            m_[i][__target__] = m_[__target__][i];
+            m_tree_[__source__].add(i, -ki_at_i);
+            m_tree_[__target__].add(i, ki_at_i);
+            m_tree_[i].add(__source__, -ki_at_i);
+            m_tree_[i].add(__target__, ki_at_i);
+        });
         m_r_[__source__] -= deg_[__vertex__];
         m_r_[__target__] += deg_[__vertex__];
 
         // Change block degrees and block sizes
-        for (auto const &neighbour: adj_list_ptr_->at(__vertex__)) {
-            --k_[neighbour][__source__];
-            ++k_[neighbour][__target__];
+        for (auto nb = graph_->begin(__vertex__); nb != graph_->end(__vertex__); ++nb) {
+            k_[*nb].add(__source__, -1);
+            k_[*nb].add(__target__, 1);
         }
 
         // Set new memberships
@@ -502,11 +475,57 @@ bool blockmodel_t::apply_mcmc_moves(const vector<mcmc_move_t> &moves, double dS)
     return true;
 }
 
-void blockmodel_t::agg_split(mt19937 &engine, bool type, int nm) noexcept {
-    vector<bool> split_mv;
+bool blockmodel_t::apply_mcmc_move_async(const mcmc_move_t &move) noexcept {
+#if SPARSE_BLOCK_COUNTS
+    return false;  // the sparse rows cannot be updated atomically; bisbm_run never gets here
+#else
+    size_t vertex = move.vertex;
+    size_t source = move.source;
+    size_t target = move.target;
+    if (!atomic_decrement_above(n_r_[source], 1)) {  // No move that makes an empty group will be allowed
+        PERF_COUNT(rejected_empty_group);
+        return false;
+    }
+    atomic_add(n_r_[target], 1);
+    atomic_sub(eta_rk_[source][deg_[vertex]], 1u);
+    atomic_add(eta_rk_[target][deg_[vertex]], 1u);
+
+    // i is a block of the other type, never source or target, so the two halves of m_ are updated separately
+    const block_counts_t& ki = k_[vertex];
+    for (size_t i = 0; i < K_; ++i) {
+        int ki_at_i = ki.load_atomic(i);  // the row changes as the neighbours of vertex move
+        if (ki_at_i == 0) {
+            continue;
+        }
+        atomic_add(m_[source][i], -ki_at_i);
+        atomic_add(m_[target][i], ki_at_i);
+        atomic_add(m_[i][source], -ki_at_i);
+        atomic_add(m_[i][target], ki_at_i);
+        m_tree_[source].add_atomic(i, -ki_at_i);
+        m_tree_[target].add_atomic(i, ki_at_i);
+        m_tree_[i].add_atomic(source, -ki_at_i);
+        m_tree_[i].add_atomic(target, ki_at_i);
+    }
+    atomic_add(m_r_[source], -deg_[vertex]);
+    atomic_add(m_r_[target], deg_[vertex]);
 
-    priority_queue<pi, vector<pi>, greater<> > q;
+    for (auto nb = graph_->begin(vertex); nb != graph_->end(vertex); ++nb) {
+        k_[*nb].add_atomic(source, -1);
+        k_[*nb].add_atomic(target, 1);
+    }
+    atomic_store(memberships_[vertex], unsigned(target));
+    return true;
+#endif
+}
+
+void blockmodel_t::finish_async_sweep() noexcept {
+    compute_m();
+    compute_members();
+    entropy_ = compute_entropy();
+}
 
+void blockmodel_t::agg_split(rng_t &engine, bool type, int nm) noexcept {
+    PERF_TIMER(agg_split);
     if (!type) {  // type-a
         blist_.resize(KA_, 0);
         iota(blist_.begin(), blist_.end(), 0);
@@ -515,86 +534,80 @@ void blockmodel_t::agg_split(mt19937 &engine, bool type, int nm) noexcept {
         iota(blist_.begin(), blist_.end(), KA_);
     }
 
-    vector<vector<bool>> split_moves;
-    split_moves.resize(nm * blist_.size());
-
-    size_t unchange{0};
-    size_t target_r{0};
-    size_t change{0};
-    double ddS = numeric_limits<double>::infinity();
-    for (auto const &v: blist_) {
-        if (n_r_[v] > 1) {
-            splitter_.clear();
-            splitter_.resize(n_r_[v], false);
-            unchange = floor(n_r_[v] / 2);
-            for (size_t i = unchange; i < n_r_[v]; ++i) {
-                splitter_[i] = true;
-            }
-        } else {
-            continue;
+    // Each block draws its nm random bisections from its own stream, split off here in block order,
+    // so that the blocks can be evaluated concurrently with the same outcome for any number of threads.
+    std::vector<rng_t> engines;
+    engines.reserve(blist_.size());
+    for (size_t i = 0; i < blist_.size(); ++i) {
+        engines.push_back(engine.split());
+    }
+    init_lgamma(2 * num_edges_ + 2);  // compute_dS reads the lgamma cache; it must not grow concurrently
+    std::vector<double> best_dS(blist_.size(), numeric_limits<double>::infinity());
+    std::vector<vector<bool>> best_split(blist_.size());
+    parallel_for(blist_.size(), num_threads_, [&](size_t i) {
+        size_t v = blist_[i];
+        if (n_r_[v] <= 1) {
+            return;
+        }
+        vector<bool> splitter(n_r_[v], false);
+        for (size_t j = n_r_[v] / 2; j < n_r_[v]; ++j) {
+            splitter[j] = true;
         }
-        shuffle(splitter_.begin(), splitter_.end(), engine);
         for (size_t i_ = 0; i_ < nm; ++i_) {
-            shuffle(splitter_.begin(), splitter_.end(), engine);
-            double dS = compute_dS(v, splitter_);
-            if (dS < ddS) {
-                split_mv = splitter_;
-                ddS = dS;
-                target_r = v;
-                change = splitter_.size() - unchange;
+            shuffle(splitter.begin(), splitter.end(), engines[i]);
+            double dS = compute_dS(v, splitter);
+            if (dS < best_dS[i]) {
+                best_dS[i] = dS;
+                best_split[i] = splitter;
             }
         }
+    });
+
+    size_t best = blist_.size();
+    double ddS = numeric_limits<double>::infinity();
+    for (size_t i = 0; i < blist_.size(); ++i) {
+        if (best_dS[i] < ddS) {
+            ddS = best_dS[i];
+            best = i;
+        }
+    }
+    if (best == blist_.size()) {
+        return;  // no block of this type can be split
     }
+    size_t target_r = blist_[best];
     vector<mcmc_move_t> moves;
-    moves.resize(change);
-    size_t order{0};
-    size_t idx{0};
-    for (auto const &_mb: memberships_) {
-        size_t node_id = &_mb - &memberships_.at(0);
-        if (_mb == target_r) {
-            if (split_mv[order]) {
-                moves[idx].vertex = node_id;
-                moves[idx].source = target_r;
-                moves[idx].target = K_;
-                idx++;
-            }
-            order++;
+    const auto &members = members_[target_r];
+    for (size_t order = 0; order < members.size(); ++order) {
+        if (best_split[best][order]) {
+            moves.emplace_back();
+            moves.back().vertex = members[order];
+            moves.back().source = target_r;
+            moves.back().target = K_;
         }
     }
     apply_split_moves(moves);
 }
 
-inline void blockmodel_t::apply_block_moves(const set<size_t>& impacted, const vector<set<size_t>>& accepted) noexcept {
-    map<int, int> n2o_map;
-    for (size_t i = 0; i < memberships_.size(); ++i) {
-        n2o_map[i] = -1;
-    }
-    for (auto &mb: memberships_) {
-        if (impacted.count(mb) > 0) {
-            for (auto const &a_: accepted) {
-                if (a_.count(mb) > 0) {
-                    mb = *a_.begin();
-                }
-            }
-        }
-    }
+inline void blockmodel_t::apply_block_moves() noexcept {
+    // relabel_[r]: new label of the group of block r, numbered by first appearance in vertex order
+    relabel_.assign(K_, -1);
     KA_ = 0;
     KB_ = 0;
     size_t n{0};
-    for (auto &mb: memberships_) {
-        size_t index = &mb - &memberships_.at(0);
-        if (n2o_map[mb] == -1) {
-            n2o_map[mb] = n;
+    for (size_t index = 0; index < memberships_.size(); ++index) {
+        size_t r = merged_blocks_.find(memberships_[index]);
+        if (relabel_[r] == -1) {
+            relabel_[r] = int(n);
             n++;
         }
-        mb = n2o_map[mb];
+        memberships_[index] = unsigned(relabel_[r]);
         if (index < na_) {
-            if (mb > KA_) {
-                KA_ = mb;
+            if (memberships_[index] > KA_) {
+                KA_ = memberships_[index];
             }
         } else {
-            if (mb > KB_) {
-                KB_ = mb;
+            if (memberships_[index] > KB_) {
+                KB_ = memberships_[index];
             }
         }
     }
@@ -610,33 +623,48 @@ inline void blockmodel_t::apply_block_moves(const set<size_t>& impacted, const v
     init_bisbm();
 }
 
-vector<mcmc_move_t> blockmodel_t::single_vertex_change(mt19937 &engine, size_t vtx) noexcept {
+inline size_t blockmodel_t::sample_neighbour_block(rng_t &engine, size_t r) const noexcept {
+    const auto &tree = m_tree_[r];
+    int total = tree.total();
+    if (total <= 0) {  // an asynchronous sweep may drive a row of m_ below zero until it ends
+        return size_t(random_real(engine) * K_);
+    }
+    size_t s = tree.find(int(random_real(engine) * total));
+    return s < K_ ? s : K_ - 1;  // a tree caught mid-update by an asynchronous sweep may overshoot
+}
+
+vector<mcmc_move_t> blockmodel_t::single_vertex_change(rng_t &engine, size_t vtx) noexcept {
+    moves_[0] = propose_vertex_move(engine, vtx);
+    return moves_;
+}
+
+mcmc_move_t blockmodel_t::propose_vertex_move(rng_t &engine, size_t vtx) const noexcept {
+    size_t source = memberships_[vtx];
+    size_t target;
     if ((types_[vtx] == 0 && KA_ == 1) || (types_[vtx] == 1 && KB_ == 1)) {
-        __target__ = memberships_[vtx];
-    } else if (adj_list_[vtx].empty()) {
-        __target__ = size_t(random_real(engine) * K_);
+        target = source;
+    } else if (graph_->degree(vtx) == 0) {
+        target = size_t(random_real(engine) * K_);
     } else {
-        which_to_move_ = size_t(random_real(engine) * adj_list_[vtx].size());
-        vertex_j_ = adj_list_[vtx][which_to_move_];
-        proposal_t_ = memberships_[vertex_j_];
-        R_t_ = epsilon_ * K_ / (m_r_[proposal_t_] + epsilon_ * K_);
+        size_t vertex_j = graph_->begin(vtx)[size_t(random_real(engine) * graph_->degree(vtx))];
+        // vertex_j and m_r_ may be moving on another thread of an asynchronous sweep
+        size_t proposal_t = atomic_load(memberships_[vertex_j]);
+        double R_t = epsilon_ * K_ / (atomic_load(m_r_[proposal_t]) + epsilon_ * K_);
 
-        if (random_real(engine) < R_t_) {
-            __target__ = size_t(random_real(engine) * K_);
+        if (random_real(engine) < R_t) {
+            target = size_t(random_real(engine) * K_);
         } else {
-            discrete_distribution<size_t> d(m_[proposal_t_].begin(), m_[proposal_t_].end());
-            __target__ = d(gen);
+            target = sample_neighbour_block(engine, proposal_t);
         }
     }
-    __source__ = memberships_[vtx];
-    moves_[0].source = __source__;
-    moves_[0].target = __target__;
-    moves_[0].vertex = vtx;
-
-    return moves_;
+    mcmc_move_t move;
+    move.vertex = vtx;
+    move.source = source;
+    move.target = target;
+    return move;
 }
 
-inline block_move_t &blockmodel_t::single_block_change(mt19937 &engine, size_t src) noexcept {
+inline block_move_t &blockmodel_t::single_block_change(rng_t &engine, size_t src) noexcept {
     if ((KA_ == 1 && src < KA_) || (KB_ == 1 && src >= KA_)) {
         bmove_.source = src;
         bmove_.target = src;
@@ -653,8 +681,7 @@ inline block_move_t &blockmodel_t::single_block_change(mt19937 &engine, size_t s
         if (random_real(engine) < R_t_) {
             __target__ = size_t(random_real(engine) * K_);
         } else {
-            discrete_distribution<size_t> d(m_[proposal_t_].begin(), m_[proposal_t_].end());
-            __target__ = d(gen);
+            __target__ = sample_neighbour_block(engine, proposal_t_);
         }
     }
     if (src > __target__) {
@@ -669,32 +696,49 @@ inline block_move_t &blockmodel_t::single_block_change(mt19937 &engine, size_t s
 }
 
 
-void blockmodel_t::shuffle_bisbm(mt19937 &engine, size_t NA, size_t NB) noexcept {
+void blockmodel_t::shuffle_bisbm(rng_t &engine, size_t NA, size_t NB) noexcept {
     shuffle(&memberships_[0], &memberships_[NA], engine);
     shuffle(&memberships_[NA], &memberships_[NA + NB], engine);
     compute_n_r();
+    compute_members();
     compute_k();
     compute_m();
     compute_m_r();
     compute_eta_rk();
+    entropy_ = compute_entropy();
 }
 
 void blockmodel_t::init_bisbm() noexcept {
+    PERF_TIMER(init_bisbm);
     compute_n_r();
+    compute_members();
     compute_k();
     compute_m();
     compute_m_r();
     compute_eta_rk();
+    entropy_ = compute_entropy();
+}
+
+bool blockmodel_t::restore(const uint_vec_t &memberships, const uint_vec_t &vlist, double entropy) noexcept {
+    memberships_ = memberships;
+    vlist_ = vlist;
+    init_bisbm();
+    // the running value only differs from a recomputation by rounding
+    if (!(std::abs(entropy - entropy_) <= 1e-6 * std::max(1., std::abs(entropy_)))) {
+        return false;
+    }
+    entropy_ = entropy;  // keep the checkpointed running value, so that resumed runs are bit-identical
+    return true;
 }
 
 // The following 4 functions should only be executed once.
 inline void blockmodel_t::compute_k() noexcept {
     k_.clear();
-    k_.resize(adj_list_ptr_->size());
-    for (size_t i = 0; i < adj_list_ptr_->size(); ++i) {
-        k_[i].resize(this->n_r_.size(), 0);
-        for (auto nb = adj_list_ptr_->at(i).begin(); nb != adj_list_ptr_->at(i).end(); ++nb) {
-            ++k_[i][memberships_[*nb]];
+    k_.resize(graph_->num_vertices());
+    for (size_t i = 0; i < graph_->num_vertices(); ++i) {
+        k_[i].clear(this->n_r_.size());
+        for (auto nb = graph_->begin(i); nb != graph_->end(i); ++nb) {
+            k_[i].add(memberships_[*nb], 1);
         }
     }
 }
@@ -705,24 +749,25 @@ inline void blockmodel_t::compute_m() noexcept {
     for (size_t i = 0; i < get_g(); ++i) {
         m_[i].resize(get_g(), 0);
     }
-    for (size_t vertex = 0; vertex < adj_list_ptr_->size(); ++vertex) {
+    for (size_t vertex = 0; vertex < graph_->num_vertices(); ++vertex) {
         __vertex__ = memberships_[vertex];
-        for (auto const &nb: adj_list_ptr_->at(vertex)) {
-            ++m_[__vertex__][memberships_[nb]];
+        for (auto nb = graph_->begin(vertex); nb != graph_->end(vertex); ++nb) {
+            ++m_[__vertex__][memberships_[*nb]];
         }
     }
+    m_tree_.resize(get_g());
+    for (size_t r = 0; r < get_g(); ++r) {
+        m_tree_[r].assign(m_[r]);
+        PERF_COUNT(proposal_trees_built);
+    }
 }
 
 inline void blockmodel_t::compute_m_r() noexcept {
+    // the row sums of m_ are the total degrees of the groups, summed in O(N) instead of O(K^2)
     m_r_.clear();
     m_r_.resize(get_g(), 0);
-    size_t _m_r = 0;
-    for (size_t r = 0; r < get_g(); ++r) {
-        _m_r = 0;
-        for (size_t s = 0; s < get_g(); ++s) {
-            _m_r += m_[r][s];
-        }
-        m_r_[r] = unsigned(int(_m_r));
+    for (size_t j = 0; j < memberships_.size(); ++j) {
+        m_r_[memberships_[j]] += deg_[j];
     }
 }
 
@@ -745,12 +790,26 @@ inline void blockmodel_t::compute_n_r() noexcept {
     }
 }
 
+inline void blockmodel_t::compute_members() noexcept {
+    members_.assign(get_g(), uint_vec_t());
+    for (size_t r = 0; r < get_g(); ++r) {
+        members_[r].reserve(n_r_[r]);
+    }
+    member_index_.resize(memberships_.size());
+    for (size_t j = 0; j < memberships_.size(); ++j) {
+        member_index_[j] = unsigned(members_[memberships_[j]].size());
+        members_[memberships_[j]].push_back(unsigned(j));
+    }
+}
+
 void blockmodel_t::summary() noexcept {
     clog << "(Ka, Kb) = (" << KA_ << ", " << KB_ << ") \n";
     clog << "entropy: " << entropy() << "\n";
 }
 
-double blockmodel_t::entropy() noexcept {
+double blockmodel_t::entropy() const noexcept { return entropy_; }
+
+double blockmodel_t::compute_entropy() noexcept {
     double ent{0};
     for (auto const &k: deg_) {
         ent -= lgamma_fast(k + 1);
@@ -769,18 +828,11 @@ double blockmodel_t::entropy() noexcept {
         ent += lgamma_fast(m_r_[index] + 1);  // sum_e_r
         ent += log_q(m_r_[index], n_r_[index]);
     }
-    for (auto const& y: adj_map_) {
-        size_t index_y = &y - &adj_map_[0];
-        for (auto const& p: y) {
-            if (p.second > 1 && index_y > p.first) {
-                ent += lgamma_fast(p.second + 1);  // sum_m_ij (sum_m_ii is always 0)
-            }
-        }
-    }
-    ent += lbinom_fast(KA_ * KB_ + num_edges_ - 1, num_edges_);
+    ent += entropy_from_multi_edges_;  // sum_m_ij, precomputed in the constructor
+    ent += lbinom_fast<false>(KA_ * KB_ + num_edges_ - 1, num_edges_);  // K may be as large as N here
     ent += lbinom_fast(na_ - 1, KA_ - 1);
     ent += lbinom_fast(nb_ - 1, KB_ - 1);
-    ent += safelog_fast(na_ * nb_);
+    ent += safelog_fast<false>(na_ * nb_);  // do not grow the cache to na * nb entries
     ent += lgamma_fast(na_ + 1);
     ent += lgamma_fast(nb_ + 1);
     return ent;
@@ -807,10 +859,10 @@ double blockmodel_t::null_entropy() noexcept {
         m[i].resize(2, 0);
     }
 
-    for (size_t vertex = 0; vertex < adj_list_ptr_->size(); ++vertex) {
+    for (size_t vertex = 0; vertex < graph_->num_vertices(); ++vertex) {
         unsigned int vtx = memberships[vertex];
-        for (auto const &nb: adj_list_ptr_->at(vertex)) {
-            ++m[vtx][memberships[nb]];
+        for (auto nb = graph_->begin(vertex); nb != graph_->end(vertex); ++nb) {
+            ++m[vtx][memberships[*nb]];
         }
     }
 
@@ -858,18 +910,11 @@ double blockmodel_t::null_entropy() noexcept {
         ent += lgamma_fast(m_r[index] + 1);  // sum_e_r
         ent += log_q(m_r[index], n_r[index]);
     }
-    for (auto const& y: adj_map_) {
-        size_t index_y = &y - &adj_map_[0];
-        for (auto const& p: y) {
-            if (p.second > 1 && index_y > p.first) {
-                ent += lgamma_fast(p.second + 1);  // sum_m_ij (sum_m_ii is always 0)
-            }
-        }
-    }
+    ent += entropy_from_multi_edges_;  // sum_m_ij, precomputed in the constructor
     ent += lbinom_fast(KA * KB + num_edges_ - 1, num_edges_);
     ent += lbinom_fast(na_ - 1, KA - 1);
     ent += lbinom_fast(nb_ - 1, KB - 1);
-    ent += safelog_fast(na_ * nb_);
+    ent += safelog_fast<false>(na_ * nb_);  // do not grow the cache to na * nb entries
     ent += lgamma_fast(na_ + 1);
     ent += lgamma_fast(nb_ + 1);
     return ent;
@@ -5,24 +5,24 @@
 #include <random>
 #include <utility>
 #include <algorithm> // std::shuffle
-#include <set>
 #include <queue>
+#include <unordered_set>
 #include "types.hh"
+#include "block_counts.hh"
+#include "csr_graph.hh"
 #include "output_functions.hh"
+#include "support/fenwick.hh"
+#include "support/disjoint_set.hh"
+#include "support/rng.hh"
 
 class blockmodel_t {
 
-protected:
-    std::uniform_real_distribution<> random_real;
-    std::random_device rd;
-    std::mt19937 gen{rd()};
-
 public:
     /** Default constructor */
     blockmodel_t(const uint_vec_t& memberships, uint_vec_t types, size_t g, size_t KA,
-                 size_t KB, double epsilon, const adj_list_t* adj_list_ptr);
+                 size_t KB, double epsilon, const csr_graph_t* graph);
 
-    const int_vec_t* get_k(size_t vertex) const noexcept;
+    const block_counts_t* get_k(size_t vertex) const noexcept;
 
     int get_degree(size_t vertex) const noexcept;
 
@@ -42,49 +42,82 @@ public:
 
     const int_vec_t* get_n_r() const noexcept;
 
+    /* Vertices of block r, in no particular order; the order changes as vertices move. */
+    const uint_vec_t& get_members(size_t r) const noexcept;
+
     size_t get_g() const noexcept;
 
     double get_epsilon() const noexcept;
 
-    double get_entropy() const noexcept;
-
     size_t get_KA() const noexcept;
 
     size_t get_KB() const noexcept;
 
     uint_vec_t& get_vlist() noexcept;
 
-    void agg_merge(std::mt19937 &engine, int diff_a, int diff_b, int nm) noexcept;
+    void agg_merge(rng_t &engine, int diff_a, int diff_b, int nm) noexcept;
 
-    void agg_merge(std::mt19937 &engine, int diff, int nm) noexcept;
+    void agg_merge(rng_t &engine, int diff, int nm) noexcept;
 
-    void agg_split(std::mt19937 &engine, bool type, int nm) noexcept;
+    /* Split the block of the given type (false: a, true: b) whose best of nm random bisections
+     * lowers the description length most. */
+    void agg_split(rng_t &engine, bool type, int nm) noexcept;
+
+    /* Number of threads evaluating the bisections of agg_split (0: one per hardware core). */
+    void set_num_threads(size_t num_threads) noexcept;
 
     double compute_dS(mcmc_move_t& move) noexcept;
 
     double compute_dS(const block_move_t& move) noexcept;
 
+    /* dS of moving the members of block mb with split_move[i] set, for the i-th member in
+     * members_[mb], to a new block. */
     double compute_dS(size_t mb, std::vector<bool>& split_move) noexcept;
 
-    std::vector< std::vector<size_t> >& get_adj_list() noexcept;
+    const csr_graph_t& get_graph() const noexcept;
 
-    void shuffle_bisbm(std::mt19937& engine, size_t NA, size_t NB) noexcept;
+    void shuffle_bisbm(rng_t& engine, size_t NA, size_t NB) noexcept;
 
     void init_bisbm() noexcept;
 
+    /* Restore a checkpointed state; the block counts are rebuilt with init_bisbm(). The checkpointed
+     * entropy is kept, so that resumed runs are bit-identical, but only if it matches the one
+     * recomputed from the memberships; returns false otherwise. */
+    bool restore(const uint_vec_t& memberships, const uint_vec_t& vlist, double entropy) noexcept;
+
     void apply_split_moves(const std::vector<mcmc_move_t>& moves) noexcept;
 
     bool apply_mcmc_moves(const std::vector<mcmc_move_t>& moves, double dS) noexcept;
 
-    void apply_block_moves(const std::set<size_t>& impacted, const std::vector<std::set<size_t>>& accepted) noexcept;
+    /* Relabel every block to the smallest block of its group in merged_blocks_. */
+    void apply_block_moves() noexcept;
+
+    std::vector<mcmc_move_t> single_vertex_change(rng_t& engine, size_t vtx) noexcept;
 
-    std::vector<mcmc_move_t> single_vertex_change(std::mt19937& engine, size_t vtx) noexcept;
+    /* The proposal of single_vertex_change, without touching any member; safe to call from the
+     * threads of an asynchronous sweep. */
+    mcmc_move_t propose_vertex_move(rng_t& engine, size_t vtx) const noexcept;
 
-    block_move_t& single_block_change(std::mt19937& engine, size_t src) noexcept;
+    /* Asynchronous sweeps. Threads moving disjoint sets of vertices may call apply_mcmc_move_async
+     * concurrently, while they read the block counts through relaxed atomic loads. n_r_, eta_rk_,
+     * m_r_, k_ and the memberships are updated with atomic deltas and are exact once the threads
+     * have joined; m_ and its trees may drift when two neighbours move at once, even below zero,
+     * so readers must bound what they load, and the member lists and the entropy are not updated
+     * at all. finish_async_sweep() rebuilds those three, and must be called before any other method
+     * once the threads have joined. Needs the dense block counts. */
+    bool apply_mcmc_move_async(const mcmc_move_t& move) noexcept;
+
+    void finish_async_sweep() noexcept;
+
+    block_move_t& single_block_change(rng_t& engine, size_t src) noexcept;
 
     void summary() noexcept;
 
-    double entropy() noexcept;
+    /* Exact description length of the current partition, maintained incrementally by apply_mcmc_moves(). */
+    double entropy() const noexcept;
+
+    /* Recompute the description length from scratch; used whenever the block structure is rebuilt. */
+    double compute_entropy() noexcept;
 
     double null_entropy() noexcept;
 
@@ -97,27 +130,29 @@ private:
     size_t K_{0};
     unsigned int max_degree_{0};
     double epsilon_{0.};
-    double entropy_{0.};  // not true entropy
-    const adj_list_t * const adj_list_ptr_;
+    double entropy_{0.};  // description length; every accepted dS is exact
+    const csr_graph_t * const graph_;  // not owned
 
-    int_mat_t k_;
+    block_counts_vec_t k_;
     int_vec_t n_r_;
 
     int_vec_t deg_;
-    std::vector< std::vector<size_t> > adj_list_;
     std::vector< std::vector<size_t> > b_adj_list_;
-    int_map_vec_t adj_map_;  // for entropy() only
     size_t num_edges_ = 0;
 
     uint_vec_t memberships_;
     uint_vec_t vlist_;
     uint_vec_t blist_;
-    std::vector<bool> splitter_;
+    std::vector<uint_vec_t> members_;  // vertices of each block, in no particular order
+    uint_vec_t member_index_;          // position of each vertex in the member list of its block
+    size_t num_threads_{1};
     const uint_vec_t types_;
 
     double entropy_from_degree_correction_{0.};
+    double entropy_from_multi_edges_{0.};  // sum_{i>j} log(m_ij!), fixed by the graph
 
     int_mat_t m_;
+    std::vector<fenwick_tree_t<int>> m_tree_;  // partial sums over each row of m_, for proposals
     int_vec_t m_r_;
     uint_mat_t eta_rk_;  // number of nodes of degree k that belong to group r.
 
@@ -125,7 +160,7 @@ private:
     size_t which_to_move_{0};
 
     /// in apply_mcmc_moves
-    const int_vec_t* ki_;
+    const block_counts_t* ki_;
 
     /// for single_vertex_change
     double R_t_{0.};
@@ -140,9 +175,22 @@ private:
     std::vector<mcmc_move_t> moves_ = std::vector<mcmc_move_t>(1);
     std::vector<block_move_t> bmoves_;
     block_move_t bmove_;
-    std::vector<std::set<size_t>> accepted_set_vec_;
+    std::unordered_set<size_t> proposed_;  // keys source * K + target of the block moves in bmoves_
+    disjoint_set_t merged_blocks_;         // groups of blocks merged by the accepted block moves
+    int_vec_t relabel_;                    // in apply_block_moves, old block -> new block, -1 if unseen
 
     /// Private methods
+    /* Draw a block s with probability m_[r][s] / m_r_[r]. */
+    size_t sample_neighbour_block(rng_t& engine, size_t r) const noexcept;
+
+    /* Draw nm block moves from each block of blist_ into bmoves_, without duplicates, and queue
+     * their dS in increasing order. */
+    void propose_block_merges(rng_t &engine, int nm,
+                              std::priority_queue<pi, std::vector<pi>, std::greater<> >& q) noexcept;
+
+    /* Group the blocks of move in merged_blocks_, unless both are grouped already. */
+    bool accept_block_merge(const block_move_t& move) noexcept;
+
     /* Compute stuff from scratch. */
     void compute_b_adj_list() noexcept;
     void compute_k() noexcept;
@@ -150,6 +198,7 @@ private:
     void compute_m_r() noexcept;
     void compute_eta_rk() noexcept;
     void compute_n_r() noexcept;
+    void compute_members() noexcept;
 };
 
 
@@ -0,0 +1,96 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include "chains.hh"
+#include "blockmodel.hh"
+#include "metropolis_hasting.hh"
+
+#include "support/cache.hh"
+#include "support/int_part.hh"
+
+void parallel_for(size_t num_jobs, size_t num_threads, const std::function<void(size_t)>& job) {
+    if (num_threads == 0) {
+        num_threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    num_threads = std::min(num_threads, num_jobs);
+
+    std::atomic<size_t> next{0};
+    auto worker = [&]() {
+        for (size_t i = next++; i < num_jobs; i = next++) {
+            job(i);
+        }
+    };
+    std::vector<std::thread> pool;
+    for (size_t t = 1; t < num_threads; ++t) {
+        pool.emplace_back(worker);
+    }
+    worker();
+    for (auto& thread: pool) {
+        thread.join();
+    }
+}
+
+void warm_up_caches(size_t num_edges, size_t NA, size_t NB, size_t KA, size_t KB, size_t max_m_r, size_t max_n_r) {
+    init_cache(num_edges);
+    // lgamma(eta_rk + 2) in transition_ratio, lgamma(KA * KB + E) in compute_entropy()
+    init_lgamma(std::max({2 * num_edges, NA + NB + 2, KA * KB + num_edges}) + 1);
+    // log_q(m_r, n_r) for the blocks of the starting state, with room for them to grow by a quarter; the whole
+    // range m_r <= E, n_r <= max(NA, NB) can take hundreds of MB that the lazy table never needs
+    init_q_cache(std::min(max_m_r + max_m_r / 4, num_edges), std::min(max_n_r + max_n_r / 4, std::max(NA, NB)));
+}
+
+void warm_up_caches(const csr_graph_t& graph, const uint_vec_t& memberships, size_t KA, size_t KB) {
+    uint_vec_t m_r(KA + KB, 0);
+    uint_vec_t n_r(KA + KB, 0);
+    for (size_t v = 0; v < memberships.size(); ++v) {
+        m_r[memberships[v]] += unsigned(graph.degree(v));
+        ++n_r[memberships[v]];
+    }
+    warm_up_caches(graph.num_edges(), graph.na(), graph.nb(), KA, KB,
+                   *std::max_element(m_r.begin(), m_r.end()), *std::max_element(n_r.begin(), n_r.end()));
+}
+
+std::vector<chain_result_t> run_chains(const uint_vec_t& memberships, const uint_vec_t& types,
+                                       size_t NA, size_t NB, size_t KA, size_t KB, double epsilon,
+                                       const csr_graph_t* graph, bool randomize,
+                                       const std::string& cooling_schedule,
+                                       const float_vec_t& cooling_schedule_kwargs,
+                                       size_t duration, size_t steps_await,
+                                       size_t converge_window, double converge_z,
+                                       size_t seed, size_t num_chains, size_t num_threads) {
+    size_t num_edges = graph->num_edges();
+    warm_up_caches(*graph, memberships, KA, KB);
+    if (cooling_schedule == "logarithmic") {
+        init_safelog(duration + size_t(cooling_schedule_kwargs[1]) + 1);
+    }
+
+    std::vector<chain_result_t> results(num_chains);
+    q_cache_freeze_t freeze;
+    parallel_for(num_chains, num_threads, [&](size_t i) {
+        auto t0 = std::chrono::steady_clock::now();
+        chain_result_t& result = results[i];
+        result.seed = seed + i;
+        rng_t engine(result.seed);
+
+        blockmodel_t blockmodel(memberships, types, KA + KB, KA, KB, epsilon, graph);
+        if (randomize) {
+            blockmodel.shuffle_bisbm(engine, NA, NB);
+        } else {
+            blockmodel.init_bisbm();
+        }
+        metropolis_hasting algorithm;
+        algorithm.set_convergence(converge_window, converge_z);
+        with_cooling_schedule(cooling_schedule, cooling_schedule_kwargs, [&](auto schedule) {
+            result.acceptance_rate = algorithm.anneal(blockmodel, schedule, duration, steps_await, engine);
+        });
+        result.convergence = algorithm.convergence();
+        result.memberships = *blockmodel.get_memberships();
+        result.KA = blockmodel.get_KA();
+        result.KB = blockmodel.get_KB();
+        result.entropy = blockmodel.entropy();
+        result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    });
+    return results;
+}
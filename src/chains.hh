@@ -0,0 +1,53 @@
+#ifndef CHAINS_HH
+#define CHAINS_HH
+
+#include <cstddef>
+#include <functional>
+#include <random>
+#include <string>
+#include "types.hh"
+#include "csr_graph.hh"
+#include "convergence.hh"
+
+/* Outcome of one annealing chain. */
+struct chain_result_t {
+    size_t seed{0};
+    uint_vec_t memberships;
+    size_t KA{0};
+    size_t KB{0};
+    double entropy{0.};
+    double acceptance_rate{0.};
+    convergence_t convergence;
+    double seconds{0.};
+};
+
+/* Run job(0), ..., job(num_jobs - 1) on a pool of num_threads worker threads.
+ * Workers pick the next unclaimed job until none is left; job must be thread-safe.
+ * num_threads == 0 means one thread per hardware core. */
+void parallel_for(size_t num_jobs, size_t num_threads, const std::function<void(size_t)>& job);
+
+/* Grow the shared caches of support/ (lgamma, safelog, log_q) before chains run concurrently, since
+ * the caches are not resized in a thread-safe way. lgamma and safelog then cover every argument a
+ * chain on this graph can request; log_q covers the block degrees and sizes up to max_m_r and
+ * max_n_r with some headroom, and the threads must hold a q_cache_freeze_t so that it does not
+ * grow beyond. */
+void warm_up_caches(size_t num_edges, size_t NA, size_t NB, size_t KA, size_t KB, size_t max_m_r, size_t max_n_r);
+
+/* warm_up_caches for chains starting from memberships on graph. */
+void warm_up_caches(const csr_graph_t& graph, const uint_vec_t& memberships, size_t KA, size_t KB);
+
+/* Anneal num_chains independent chains from the same initial memberships, sharing the read-only
+ * adjacency list, with the cooling schedule of that name (see cooling_schedules.hh) and the
+ * convergence test of metropolis_hasting::set_convergence. Chain i draws
+ * from an rng_t seeded with seed + i, so that it can be reproduced alone with that seed. Results are
+ * returned in chain order. */
+std::vector<chain_result_t> run_chains(const uint_vec_t& memberships, const uint_vec_t& types,
+                                       size_t NA, size_t NB, size_t KA, size_t KB, double epsilon,
+                                       const csr_graph_t* graph, bool randomize,
+                                       const std::string& cooling_schedule,
+                                       const float_vec_t& cooling_schedule_kwargs,
+                                       size_t duration, size_t steps_await,
+                                       size_t converge_window, double converge_z,
+                                       size_t seed, size_t num_chains, size_t num_threads);
+
+#endif // CHAINS_HH
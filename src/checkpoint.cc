@@ -0,0 +1,121 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+
+#include "checkpoint.hh"
+
+// Layout (native endianness):
+//   char[8]   magic "BISBMCK2"
+//   uint64    N, KA, KB, sweep, u, accepted_steps
+//   double    entropy_min, entropy
+//   uint32[N] memberships
+//   uint32[N] vlist
+//   uint32    number of words W (4), uint64[W] engine state (rng_t::state())
+static const char checkpoint_magic[8] = {'B', 'I', 'S', 'B', 'M', 'C', 'K', '2'};
+
+template<typename T>
+inline void write_pod(std::ofstream& file, T value) {
+    file.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template<typename T>
+inline bool read_pod(std::ifstream& file, T& value) {
+    return bool(file.read(reinterpret_cast<char*>(&value), sizeof(T)));
+}
+
+static void write_engine(std::ofstream& file, const rng_t& engine) {
+    rng_t::state_t state = engine.state();
+    write_pod(file, uint32_t(state.size()));
+    for (auto const& word: state) write_pod(file, word);
+}
+
+static bool read_engine(std::ifstream& file, rng_t& engine) {
+    uint32_t num_words{0};
+    if (!read_pod(file, num_words) || num_words != rng_t::state_t().size()) return false;
+    rng_t::state_t state;
+    for (auto& word: state) {
+        if (!read_pod(file, word)) return false;
+    }
+    if (std::all_of(state.begin(), state.end(), [](uint64_t word) { return word == 0; })) return false;
+    engine.set_state(state);
+    return true;
+}
+
+bool save_checkpoint(const checkpoint_t& checkpoint, const std::string& path) {
+    std::string tmp_path = path + ".tmp";
+    std::ofstream file(tmp_path.c_str(), std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) return false;
+
+    file.write(checkpoint_magic, sizeof(checkpoint_magic));
+    write_pod(file, uint64_t(checkpoint.memberships.size()));
+    write_pod(file, uint64_t(checkpoint.KA));
+    write_pod(file, uint64_t(checkpoint.KB));
+    write_pod(file, uint64_t(checkpoint.sweep));
+    write_pod(file, uint64_t(checkpoint.u));
+    write_pod(file, uint64_t(checkpoint.accepted_steps));
+    write_pod(file, checkpoint.entropy_min);
+    write_pod(file, checkpoint.entropy);
+    for (auto const& mb: checkpoint.memberships) write_pod(file, uint32_t(mb));
+    for (auto const& v: checkpoint.vlist) write_pod(file, uint32_t(v));
+    write_engine(file, checkpoint.engine);
+    file.close();
+    if (file.fail()) return false;
+    return std::rename(tmp_path.c_str(), path.c_str()) == 0;
+}
+
+bool load_checkpoint(checkpoint_t& checkpoint, const std::string& path) {
+    std::ifstream file(path.c_str(), std::ios::binary);
+    if (!file.is_open()) return false;
+
+    char magic[sizeof(checkpoint_magic)];
+    if (!file.read(magic, sizeof(magic)) || !std::equal(magic, magic + sizeof(magic), checkpoint_magic)) {
+        return false;
+    }
+    uint64_t N, KA, KB, sweep, u, accepted_steps;
+    if (!(read_pod(file, N) && read_pod(file, KA) && read_pod(file, KB) && read_pod(file, sweep)
+          && read_pod(file, u) && read_pod(file, accepted_steps)
+          && read_pod(file, checkpoint.entropy_min) && read_pod(file, checkpoint.entropy))) {
+        return false;
+    }
+    checkpoint.KA = KA;
+    checkpoint.KB = KB;
+    checkpoint.sweep = sweep;
+    checkpoint.u = u;
+    checkpoint.accepted_steps = accepted_steps;
+    checkpoint.memberships.resize(N);
+    checkpoint.vlist.resize(N);
+    for (auto& mb: checkpoint.memberships) {
+        uint32_t value;
+        if (!read_pod(file, value)) return false;
+        mb = value;
+    }
+    for (auto& v: checkpoint.vlist) {
+        uint32_t value;
+        if (!read_pod(file, value)) return false;
+        v = value;
+    }
+    return read_engine(file, checkpoint.engine);
+}
+
+bool checkpoint_fits(const checkpoint_t& checkpoint, size_t NA, size_t NB, size_t KA, size_t KB) {
+    size_t N = NA + NB;
+    if (checkpoint.memberships.size() != N || checkpoint.vlist.size() != N || checkpoint.KA != KA
+        || checkpoint.KB != KB) {
+        return false;
+    }
+    for (size_t v = 0; v < N; ++v) {
+        size_t r = checkpoint.memberships[v];
+        if (v < NA ? r >= KA : (r < KA || r >= KA + KB)) {
+            return false;
+        }
+    }
+    std::vector<bool> seen(N, false);
+    for (auto const& v: checkpoint.vlist) {
+        if (v >= N || seen[v]) {
+            return false;
+        }
+        seen[v] = true;
+    }
+    return true;
+}
@@ -0,0 +1,34 @@
+#ifndef CHECKPOINT_HH
+#define CHECKPOINT_HH
+
+#include <limits>
+#include <string>
+#include "types.hh"
+#include "support/rng.hh"
+
+/* Everything needed to resume metropolis_hasting::anneal bit-identically.
+ * The block counts (n_r_, m_, k_, eta_rk_) are not stored: they are rebuilt from the memberships. */
+struct checkpoint_t {
+    size_t sweep{0};  // next sweep to run
+    size_t u{0};  // steps_await counter
+    size_t accepted_steps{0};
+    double entropy_min{std::numeric_limits<double>::infinity()};
+    double entropy{0.};  // blockmodel_t::entropy()
+    size_t KA{0};
+    size_t KB{0};
+    uint_vec_t memberships;
+    uint_vec_t vlist;
+    rng_t engine;  // the engine passed to anneal, which draws every proposal
+};
+
+/* Write a checkpoint to a temporary file, then rename it over path. Returns true on success. */
+bool save_checkpoint(const checkpoint_t& checkpoint, const std::string& path);
+
+/* Load a checkpoint written by save_checkpoint. Returns true on success. */
+bool load_checkpoint(checkpoint_t& checkpoint, const std::string& path);
+
+/* Whether checkpoint fits a run on NA + NB vertices, the first NA of type a, in (KA, KB) groups: every
+ * label is a group of the type of its vertex, and vlist is a permutation of the vertices. */
+bool checkpoint_fits(const checkpoint_t& checkpoint, size_t NA, size_t NB, size_t KA, size_t KB);
+
+#endif // CHECKPOINT_HH
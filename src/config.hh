@@ -1,3 +0,0 @@
-#define HAVE_LIBBOOST_PROGRAM_OPTIONS 1
-#define HAVE_STEADY_CLOCK 1
-#define LOGGING 1
@@ -0,0 +1,86 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include "convergence.hh"
+
+namespace {
+
+/* Mean of trace[begin, end) and the batch-means estimate of its variance. */
+void batch_means(const std::deque<double>& trace, size_t begin, size_t end, double& mean, double& variance) {
+    size_t n = end - begin;
+    mean = 0.;
+    for (size_t i = begin; i < end; ++i) {
+        mean += trace[i];
+    }
+    mean /= double(n);
+
+    // Batches of about sqrt(n) sweeps, whose means are close to independent; the first n % size
+    // sweeps are left out of the variance.
+    size_t size = std::max(size_t(std::sqrt(double(n))), size_t(1));
+    size_t num_batches = n / size;
+    if (num_batches < 2) {
+        size = 1;
+        num_batches = n;
+    }
+    double batch_mean = 0.;
+    std::vector<double> means(num_batches, 0.);
+    for (size_t k = 0; k < num_batches; ++k) {
+        for (size_t i = end - (num_batches - k) * size, j = 0; j < size; ++i, ++j) {
+            means[k] += trace[i];
+        }
+        means[k] /= double(size);
+        batch_mean += means[k];
+    }
+    batch_mean /= double(num_batches);
+    double sum = 0.;
+    for (auto const& m: means) {
+        sum += (m - batch_mean) * (m - batch_mean);
+    }
+    variance = num_batches < 2 ? 0. : sum / double(num_batches - 1) / double(num_batches);
+}
+
+}  // namespace
+
+double geweke_z(const std::deque<double>& trace) {
+    size_t n = trace.size();
+    size_t first = std::max(n / 10, size_t(1));
+    double mean_a, variance_a, mean_b, variance_b;
+    batch_means(trace, 0, first, mean_a, variance_a);
+    batch_means(trace, n - n / 2, n, mean_b, variance_b);
+    double difference = mean_a - mean_b;
+    if (difference == 0.) {
+        return 0.;
+    }
+    double error = std::sqrt(variance_a + variance_b);
+    return error > 0. ? difference / error : std::copysign(std::numeric_limits<double>::infinity(), difference);
+}
+
+void convergence_monitor_t::reset(size_t window, double z_max) {
+    window_ = window;
+    z_max_ = z_max;
+    clear();
+}
+
+void convergence_monitor_t::clear() noexcept {
+    entropy_.clear();
+    acceptance_.clear();
+    entropy_z_ = 0.;
+    acceptance_z_ = 0.;
+}
+
+bool convergence_monitor_t::add(double entropy, double acceptance_rate) {
+    entropy_.push_back(entropy);
+    acceptance_.push_back(acceptance_rate);
+    if (entropy_.size() > window_) {
+        entropy_.pop_front();
+        acceptance_.pop_front();
+    }
+    if (window_ == 0 || entropy_.size() < window_) {
+        return false;
+    }
+    entropy_z_ = geweke_z(entropy_);
+    acceptance_z_ = geweke_z(acceptance_);
+    return std::abs(entropy_z_) <= z_max_ && std::abs(acceptance_z_) <= z_max_;
+}
@@ -0,0 +1,52 @@
+#ifndef CONVERGENCE_HH
+#define CONVERGENCE_HH
+
+#include <cstddef>
+#include <deque>
+
+/* Outcome of the convergence test of an annealing run. */
+struct convergence_t {
+    bool converged{false};  // stopped by the test rather than by steps_await or the end of the run
+    size_t sweeps{0};       // sweeps run
+    double entropy_z{0.};   // last Geweke z-scores of the entropy and acceptance rate traces
+    double acceptance_z{0.};
+};
+
+/* Geweke diagnostic of the last sweeps of an annealing run.
+ *
+ * The monitor keeps the entropy and the acceptance rate of the last `window` sweeps. Once the
+ * window is full, each trace is tested by comparing the mean of its first 10% with the mean of its
+ * last 50%: z is their difference divided by the standard error, estimated by batch means so that
+ * the correlation between successive sweeps does not make the test overconfident. The chain has
+ * stabilised when both |z| are at most z_max. A trace that stays constant has z = 0. */
+class convergence_monitor_t {
+public:
+    /* Test windows of `window` sweeps (0 disables the test) against z_max, and forget the traces. */
+    void reset(size_t window, double z_max);
+
+    /* Forget the traces, keeping the settings. */
+    void clear() noexcept;
+
+    bool enabled() const noexcept { return window_ > 0; }
+
+    /* Record one sweep; returns true if the last `window` sweeps passed the test. */
+    bool add(double entropy, double acceptance_rate);
+
+    double entropy_z() const noexcept { return entropy_z_; }
+
+    double acceptance_z() const noexcept { return acceptance_z_; }
+
+private:
+    size_t window_{0};
+    double z_max_{2.};
+    std::deque<double> entropy_;
+    std::deque<double> acceptance_;
+    double entropy_z_{0.};
+    double acceptance_z_{0.};
+};
+
+/* Geweke z-score of trace: mean of its first 10% minus mean of its last 50%, over the batch-means
+ * standard error of that difference. */
+double geweke_z(const std::deque<double>& trace);
+
+#endif // CONVERGENCE_HH
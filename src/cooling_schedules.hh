@@ -0,0 +1,138 @@
+#ifndef COOLING_SCHEDULES_HH
+#define COOLING_SCHEDULES_HH
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include "types.hh"
+#include "support/cache.hh"
+
+/* Cooling schedules, as policy types that metropolis_hasting::anneal is templated on.
+ *
+ * A schedule gives the temperature of step t through operator(), inlined into the annealing loop,
+ * and is told the acceptance rate of every finished sweep through end_sweep(). Schedules whose
+ * temperature does not change within a sweep set per_sweep, and are then evaluated once per sweep.
+ * The arguments are those of -a, in the order listed in the README; see
+ * http://www.fys.ku.dk/~andresen/BAhome/ownpapers/permanents/annealSched.pdf */
+
+/* T(t) = T_0 * alpha^t */
+struct exponential_schedule_t {
+    static constexpr bool per_sweep = false;
+
+    explicit exponential_schedule_t(const float_vec_t& kwargs) : T0_(kwargs[0]), alpha_(kwargs[1]) {}
+
+    inline double operator()(size_t t) const noexcept { return T0_ * std::pow(alpha_, double(t)); }
+
+    inline void end_sweep(double) noexcept {}
+
+private:
+    double T0_;
+    double alpha_;
+};
+
+/* T(t) = T_0 - eta * t */
+struct linear_schedule_t {
+    static constexpr bool per_sweep = false;
+
+    explicit linear_schedule_t(const float_vec_t& kwargs) : T0_(kwargs[0]), eta_(kwargs[1]) {}
+
+    inline double operator()(size_t t) const noexcept { return T0_ - eta_ * double(t); }
+
+    inline void end_sweep(double) noexcept {}
+
+private:
+    double T0_;
+    double eta_;
+};
+
+/* T(t) = c / log(t + d), read from the safelog table, which covers the whole run once grown. */
+struct logarithmic_schedule_t {
+    static constexpr bool per_sweep = false;
+
+    explicit logarithmic_schedule_t(const float_vec_t& kwargs) : c_(kwargs[0]), d_(kwargs[1]) {}
+
+    inline double operator()(size_t t) const noexcept { return c_ / safelog_fast(size_t(double(t) + d_)); }
+
+    inline void end_sweep(double) noexcept {}
+
+private:
+    double c_;
+    double d_;
+};
+
+/* T(t) = T */
+struct constant_schedule_t {
+    static constexpr bool per_sweep = true;
+
+    explicit constant_schedule_t(double temperature) : temperature_(temperature) {}
+
+    explicit constant_schedule_t(const float_vec_t& kwargs) : temperature_(kwargs[0]) {}
+
+    inline double operator()(size_t) const noexcept { return temperature_; }
+
+    inline void end_sweep(double) noexcept {}
+
+private:
+    double temperature_;
+};
+
+/* T(t) = 1 if t < tau else 0 */
+struct abrupt_cool_schedule_t {
+    static constexpr bool per_sweep = false;
+
+    explicit abrupt_cool_schedule_t(const float_vec_t& kwargs) : tau_(kwargs[0]) {}
+
+    inline double operator()(size_t t) const noexcept { return double(t) < tau_ ? 1. : 0.; }
+
+    inline void end_sweep(double) noexcept {}
+
+private:
+    double tau_;
+};
+
+/* Temperature steered by the acceptance rate: it starts at T_0 and, after every sweep, is scaled by
+ * exp((r - a) / r), clamped to [1/e, e], where a is the acceptance rate of the sweep and r the target
+ * rate. The target starts at r_0 and is multiplied by gamma every sweep, so that the chain cools at
+ * the pace the landscape allows rather than at a fixed one. */
+struct adaptive_schedule_t {
+    static constexpr bool per_sweep = true;
+
+    explicit adaptive_schedule_t(const float_vec_t& kwargs)
+            : temperature_(kwargs[0]), target_(kwargs[1]), gamma_(kwargs[2]) {}
+
+    inline double operator()(size_t) const noexcept { return temperature_; }
+
+    inline void end_sweep(double acceptance_rate) noexcept {
+        double error = (target_ - acceptance_rate) / target_;
+        temperature_ *= std::exp(std::max(-1., std::min(1., error)));
+        target_ *= gamma_;
+    }
+
+private:
+    double temperature_;
+    double target_;
+    double gamma_;
+};
+
+/* Call f with the schedule named `name`, built from kwargs. Returns false if there is no such schedule. */
+template <class F>
+bool with_cooling_schedule(const std::string& name, const float_vec_t& kwargs, F&& f) {
+    if (name == "exponential") {
+        f(exponential_schedule_t(kwargs));
+    } else if (name == "linear") {
+        f(linear_schedule_t(kwargs));
+    } else if (name == "logarithmic") {
+        f(logarithmic_schedule_t(kwargs));
+    } else if (name == "constant") {
+        f(constant_schedule_t(kwargs));
+    } else if (name == "abrupt_cool") {
+        f(abrupt_cool_schedule_t(kwargs));
+    } else if (name == "adaptive") {
+        f(adaptive_schedule_t(kwargs));
+    } else {
+        return false;
+    }
+    return true;
+}
+
+#endif // COOLING_SCHEDULES_HH
@@ -0,0 +1,113 @@
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include "csr_graph.hh"
+
+static const char csr_magic[8] = {'B', 'I', 'S', 'B', 'M', 'C', 'S', 'R'};
+static const uint32_t csr_version = 1;
+
+struct csr_header_t {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t num_vertices;
+    uint64_t num_entries;
+    uint64_t na;
+    uint64_t nb;
+};
+
+csr_graph_t::csr_graph_t(const edge_list_t& edge_list, size_t num_vertices, size_t na, size_t nb) :
+        na_(na), nb_(nb) {
+    for (auto const& edge: edge_list) {
+        num_vertices = std::max(num_vertices, std::max(edge.first, edge.second) + 1);
+    }
+    num_vertices_ = num_vertices;
+    num_entries_ = 2 * edge_list.size();
+
+    offsets_storage_.assign(num_vertices + 1, 0);
+    for (auto const& edge: edge_list) {
+        ++offsets_storage_[edge.first + 1];
+        ++offsets_storage_[edge.second + 1];
+    }
+    for (size_t v = 0; v < num_vertices; ++v) {
+        offsets_storage_[v + 1] += offsets_storage_[v];
+    }
+    std::vector<uint64_t> cursor(offsets_storage_.begin(), offsets_storage_.end() - 1);
+    neighbours_storage_.resize(num_entries_);
+    for (auto const& edge: edge_list) {
+        neighbours_storage_[cursor[edge.first]++] = uint32_t(edge.second);
+        neighbours_storage_[cursor[edge.second]++] = uint32_t(edge.first);
+    }
+    offsets_ = offsets_storage_.data();
+    neighbours_ = neighbours_storage_.data();
+}
+
+csr_graph_t::csr_graph_t(const adj_list_t& adj_list, size_t na, size_t nb) :
+        num_vertices_(adj_list.size()), na_(na), nb_(nb) {
+    offsets_storage_.assign(num_vertices_ + 1, 0);
+    for (size_t v = 0; v < num_vertices_; ++v) {
+        offsets_storage_[v + 1] = offsets_storage_[v] + adj_list[v].size();
+    }
+    num_entries_ = offsets_storage_[num_vertices_];
+    neighbours_storage_.reserve(num_entries_);
+    for (auto const& neighbourhood: adj_list) {
+        for (auto const& u: neighbourhood) {
+            neighbours_storage_.push_back(uint32_t(u));
+        }
+    }
+    offsets_ = offsets_storage_.data();
+    neighbours_ = neighbours_storage_.data();
+}
+
+csr_graph_t::csr_graph_t(const uint64_t* offsets, const uint32_t* neighbours, size_t num_vertices,
+                         size_t na, size_t nb) :
+        num_vertices_(num_vertices), num_entries_(offsets[num_vertices]), na_(na), nb_(nb),
+        offsets_(offsets), neighbours_(neighbours) {}
+
+adj_list_t csr_graph_t::to_adj_list() const {
+    adj_list_t adj_list(num_vertices_);
+    for (size_t v = 0; v < num_vertices_; ++v) {
+        adj_list[v].assign(begin(v), end(v));
+    }
+    return adj_list;
+}
+
+bool csr_graph_t::save(const std::string& path) const {
+    std::ofstream file(path.c_str(), std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) return false;
+    csr_header_t header{};
+    std::memcpy(header.magic, csr_magic, sizeof(csr_magic));
+    header.version = csr_version;
+    header.num_vertices = num_vertices_;
+    header.num_entries = num_entries_;
+    header.na = na_;
+    header.nb = nb_;
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(offsets_), sizeof(uint64_t) * (num_vertices_ + 1));
+    file.write(reinterpret_cast<const char*>(neighbours_), sizeof(uint32_t) * num_entries_);
+    return bool(file);
+}
+
+bool csr_graph_t::load(const std::string& path) {
+    auto file = std::make_shared<mapped_file_t>(path);
+    if (!file->is_open() || file->size() < sizeof(csr_header_t)) return false;
+    csr_header_t header{};
+    std::memcpy(&header, file->data(), sizeof(header));
+    if (std::memcmp(header.magic, csr_magic, sizeof(csr_magic)) != 0 || header.version != csr_version) {
+        return false;
+    }
+    size_t expected = sizeof(csr_header_t) + sizeof(uint64_t) * (header.num_vertices + 1)
+                      + sizeof(uint32_t) * header.num_entries;
+    if (file->size() != expected) return false;
+
+    num_vertices_ = header.num_vertices;
+    num_entries_ = header.num_entries;
+    na_ = header.na;
+    nb_ = header.nb;
+    offsets_storage_.clear();
+    neighbours_storage_.clear();
+    offsets_ = reinterpret_cast<const uint64_t*>(file->data() + sizeof(csr_header_t));
+    neighbours_ = reinterpret_cast<const uint32_t*>(offsets_ + num_vertices_ + 1);
+    file_ = file;
+    return true;
+}
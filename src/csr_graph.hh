@@ -0,0 +1,85 @@
+#ifndef CSR_GRAPH_HH
+#define CSR_GRAPH_HH
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "types.hh"
+#include "support/mapped_file.hh"
+
+/* Undirected graph in compressed sparse row form, with 32-bit vertex ids.
+ *
+ * The neighbours of vertex v are neighbours()[offsets()[v]], ..., neighbours()[offsets()[v + 1] - 1],
+ * in the order in which edge_to_adj would list them. Vertices are ordered by type: the first na()
+ * are of type a, the next nb() of type b.
+ *
+ * The arrays either live in memory, are borrowed from the caller, or point directly into a
+ * memory-mapped binary file, so that repeated runs on the same graph share it through the page
+ * cache. The binary layout is
+ *   char[8]       magic "BISBMCSR"
+ *   uint32        version (1), uint32 reserved
+ *   uint64        num_vertices, num_entries (twice the number of edges), na, nb
+ *   uint64[N + 1] offsets
+ *   uint32[2E]    neighbours
+ * in native endianness. */
+class csr_graph_t {
+public:
+    csr_graph_t() = default;
+    csr_graph_t(const csr_graph_t&) = delete;
+    csr_graph_t& operator=(const csr_graph_t&) = delete;
+    csr_graph_t(csr_graph_t&&) = default;
+    csr_graph_t& operator=(csr_graph_t&&) = default;
+
+    /* Build from an edge list; num_vertices is grown to cover every vertex id. */
+    csr_graph_t(const edge_list_t& edge_list, size_t num_vertices, size_t na, size_t nb);
+
+    /* Copy an adjacency list, in which every edge appears at both of its ends. */
+    csr_graph_t(const adj_list_t& adj_list, size_t na, size_t nb);
+
+    /* Borrow CSR arrays owned by the caller (offsets has num_vertices + 1 entries); nothing is
+     * copied, so the arrays must outlive the graph. */
+    csr_graph_t(const uint64_t* offsets, const uint32_t* neighbours, size_t num_vertices, size_t na, size_t nb);
+
+    size_t num_vertices() const noexcept { return num_vertices_; }
+
+    size_t num_edges() const noexcept { return num_entries_ / 2; }
+
+    size_t na() const noexcept { return na_; }
+
+    size_t nb() const noexcept { return nb_; }
+
+    const uint64_t* offsets() const noexcept { return offsets_; }
+
+    const uint32_t* neighbours() const noexcept { return neighbours_; }
+
+    inline size_t degree(size_t v) const noexcept { return size_t(offsets_[v + 1] - offsets_[v]); }
+
+    inline const uint32_t* begin(size_t v) const noexcept { return neighbours_ + offsets_[v]; }
+
+    inline const uint32_t* end(size_t v) const noexcept { return neighbours_ + offsets_[v + 1]; }
+
+    /* Copy into the adjacency list layout used by blockmodel_t. */
+    adj_list_t to_adj_list() const;
+
+    /* Write the binary file. Returns true on success. */
+    bool save(const std::string& path) const;
+
+    /* Map a binary file written by save. Returns true on success. */
+    bool load(const std::string& path);
+
+private:
+    size_t num_vertices_{0};
+    size_t num_entries_{0};
+    size_t na_{0};
+    size_t nb_{0};
+    const uint64_t* offsets_{nullptr};
+    const uint32_t* neighbours_{nullptr};
+
+    // Storage: owned arrays or a mapped file; neither when the arrays are borrowed.
+    std::vector<uint64_t> offsets_storage_;
+    std::vector<uint32_t> neighbours_storage_;
+    std::shared_ptr<mapped_file_t> file_;
+};
+
+#endif // CSR_GRAPH_HH
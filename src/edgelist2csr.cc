@@ -0,0 +1,56 @@
+/* ~~~~~~~~~~~~~~~~ Notes ~~~~~~~~~~~~~~~~ */
+// Convert a text edge list to the binary CSR format read by `bin/mcmc --csr_path`.
+//
+// Usage:
+//   bin/edgelist2csr <edge_list_path> <csr_path> <NA> <NB>
+//
+// NA and NB are the numbers of type-a and type-b vertices (as passed to -y);
+// they are stored in the header of the CSR file.
+
+/* ~~~~~~~~~~~~~~~~ Includes ~~~~~~~~~~~~~~~~ */
+// STL
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <string>
+// Program headers
+#include "types.hh"
+#include "csr_graph.hh"
+#include "graph_utilities.hh"
+
+int main(int argc, char const *argv[]) {
+    if (argc != 5) {
+        std::clog << "Convert a text edge list to a binary CSR graph.\n";
+        std::clog << "Usage:\n"
+                  << "  " + std::string(argv[0]) + " <edge_list_path> <csr_path> <NA> <NB>\n";
+        return 1;
+    }
+    std::string edge_list_path = argv[1];
+    std::string csr_path = argv[2];
+    size_t NA = std::stoul(argv[3]);
+    size_t NB = std::stoul(argv[4]);
+
+    edge_list_t edge_list;
+    if (!load_edge_list(edge_list, edge_list_path, 0)) {
+        std::cerr << "Cannot open edge list " << edge_list_path << "\n";
+        return 1;
+    }
+    for (auto const& edge: edge_list) {
+        if (std::max(edge.first, edge.second) >= NA + NB) {
+            std::cerr << "The edge list has vertex ids beyond NA + NB = " << NA + NB << ".\n";
+            return 1;
+        }
+    }
+    if (NA + NB > UINT32_MAX) {
+        std::cerr << "Vertex ids must fit in 32 bits.\n";
+        return 1;
+    }
+    csr_graph_t graph(edge_list, NA + NB, NA, NB);
+    if (!graph.save(csr_path)) {
+        std::cerr << "Cannot write " << csr_path << "\n";
+        return 1;
+    }
+    std::clog << "Wrote " << graph.num_vertices() << " vertices and " << graph.num_edges() << " edges to "
+              << csr_path << "\n";
+    return 0;
+}
@@ -1,35 +1,95 @@
 #include <iostream>
+#include <algorithm>
+#include <cstring>
+#include <thread>
 #include "graph_utilities.hh"
+#include "support/mapped_file.hh"
 
 
-bool load_memberships(uint_vec_t &memberships, const std::string& membership_path) {
-    memberships.clear();
-    std::ifstream beliefs_file(membership_path.c_str());
-    if (!beliefs_file.is_open()) return false;
-    std::string line_buffer;
-    size_t membership;
-    while (getline(beliefs_file, line_buffer)) {
-        std::stringstream linestream(line_buffer);
-        linestream >> membership;
-        memberships.push_back(membership);
-    }
-    beliefs_file.close();
-    return true;
+/* Parse the first two unsigned integers of every line in [begin, end). Lines with fewer than two
+ * integers, and comment lines starting with '#' or '%', are skipped; further columns are ignored. */
+static void parse_edges(const char* begin, const char* end, edge_list_t& edge_list) {
+    const char* p = begin;
+    while (p < end) {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == '\r')) ++p;
+        if (p < end && *p != '#' && *p != '%') {
+            size_t ids[2];
+            int found = 0;
+            while (p < end && *p != '\n' && found < 2) {
+                if (*p >= '0' && *p <= '9') {
+                    size_t value = 0;
+                    while (p < end && *p >= '0' && *p <= '9') {
+                        value = value * 10 + size_t(*p - '0');
+                        ++p;
+                    }
+                    ids[found++] = value;
+                } else {
+                    ++p;
+                }
+            }
+            if (found == 2) {
+                edge_list.emplace_back(ids[0], ids[1]);
+            }
+        }
+        while (p < end && *p != '\n') ++p;
+        ++p;
+    }
 }
 
-bool load_edge_list(edge_list_t &edge_list, const std::string& edge_list_path) {
+/* Number of lines in [begin, end), an upper bound on the number of edges parse_edges finds there; one
+ * pass with memchr costs little next to the parse, and lets the edges be stored without reallocating. */
+static size_t count_lines(const char* begin, const char* end) {
+    size_t lines = 0;
+    for (const char* p = begin; p < end; ++lines) {
+        const void* newline = std::memchr(p, '\n', size_t(end - p));
+        p = newline == nullptr ? end : static_cast<const char*>(newline) + 1;
+    }
+    return lines;
+}
+
+bool load_edge_list(edge_list_t &edge_list, const std::string& edge_list_path, size_t num_threads) {
     edge_list.clear();
-    std::ifstream edge_list_file(edge_list_path.c_str());
-    if (!edge_list_file.is_open()) return false;
-    std::string line_buffer;
-    size_t node_a, node_b;
-    while (getline(edge_list_file, line_buffer)) {
-        std::stringstream linestream(line_buffer);
-        linestream >> node_a;
-        linestream >> node_b;
-        edge_list.push_back(std::make_pair(node_a, node_b));
-    }
-    edge_list_file.close();
+    mapped_file_t file(edge_list_path);
+    if (!file.is_open()) return false;
+    const char* begin = file.data();
+    const char* end = begin + file.size();
+
+    if (num_threads == 0) {
+        num_threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    // Below a few MB, threads cost more than they save.
+    num_threads = std::max(size_t(1), std::min(num_threads, file.size() / (size_t(1) << 22)));
+    if (num_threads == 1) {
+        edge_list.reserve(count_lines(begin, end));
+        parse_edges(begin, end, edge_list);
+        return true;
+    }
+
+    // Split the file into chunks at line boundaries and parse them concurrently.
+    std::vector<const char*> bounds(num_threads + 1, end);
+    bounds[0] = begin;
+    for (size_t t = 1; t < num_threads; ++t) {
+        const char* p = std::max(begin + file.size() * t / num_threads, bounds[t - 1]);
+        while (p < end && *(p - 1) != '\n') ++p;
+        bounds[t] = p;
+    }
+    std::vector<edge_list_t> chunks(num_threads);
+    std::vector<std::thread> pool;
+    for (size_t t = 0; t < num_threads; ++t) {
+        pool.emplace_back([&, t]() {
+            chunks[t].reserve(count_lines(bounds[t], bounds[t + 1]));
+            parse_edges(bounds[t], bounds[t + 1], chunks[t]);
+        });
+    }
+    size_t num_edges = 0;
+    for (size_t t = 0; t < num_threads; ++t) {
+        pool[t].join();
+        num_edges += chunks[t].size();
+    }
+    edge_list.reserve(num_edges);
+    for (auto const& chunk: chunks) {
+        edge_list.insert(edge_list.end(), chunk.begin(), chunk.end());
+    }
     return true;
 }
 
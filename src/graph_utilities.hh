@@ -7,11 +7,10 @@
 #include <cmath>
 #include "types.hh"
 
-/* Load beliefs of memberships of each node. Returns true on sucess. */
-bool load_memberships(uint_vec_t& memberships, const std::string& membership_path);
-
-/* Load an edge list. Result passed by reference. Returns true on success. */
-bool load_edge_list(edge_list_t & edge_list, const std::string& edge_list_path);
+/* Load an edge list (two vertex ids per line; other columns are ignored). The file is memory-mapped
+ * and, when num_threads != 1, parsed in parallel chunks (0: one per hardware core).
+ * Result passed by reference. Returns true on success. */
+bool load_edge_list(edge_list_t & edge_list, const std::string& edge_list_path, size_t num_threads=1);
 
 /* Convert adjacency list to edge list. Result passed by reference. */
 adj_list_t edge_to_adj(const edge_list_t & edge_list, size_t num_vertices=0);
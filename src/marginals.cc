@@ -0,0 +1,78 @@
+#include <algorithm>
+#include <fstream>
+
+#include "marginals.hh"
+
+void marginals_t::reset(const uint_vec_t& memberships) {
+    size_t N = memberships.size();
+    counts_.assign(N, std::vector<entry_t>());
+    label_ = memberships;
+    since_.assign(N, 0);
+    touched_.assign(N, false);
+    touched_list_.clear();
+    num_samples_ = 0;
+}
+
+void marginals_t::sample(const uint_vec_t& memberships) noexcept {
+    for (auto const& v: touched_list_) {
+        touched_[v] = false;
+        if (memberships[v] == label_[v]) {
+            continue;
+        }
+        if (num_samples_ > since_[v]) {
+            auto& counts = counts_[v];
+            auto it = std::lower_bound(counts.begin(), counts.end(), label_[v],
+                                       [](const entry_t& e, unsigned int r) { return e.first < r; });
+            if (it == counts.end() || it->first != label_[v]) {
+                it = counts.insert(it, std::make_pair(label_[v], 0u));
+            }
+            it->second += unsigned(num_samples_ - since_[v]);
+        }
+        label_[v] = memberships[v];
+        since_[v] = num_samples_;
+    }
+    touched_list_.clear();
+    ++num_samples_;
+}
+
+std::vector<marginals_t::entry_t> marginals_t::counts_of(size_t vertex) const {
+    std::vector<entry_t> counts = counts_[vertex];
+    if (num_samples_ > since_[vertex]) {
+        auto it = std::lower_bound(counts.begin(), counts.end(), label_[vertex],
+                                   [](const entry_t& e, unsigned int r) { return e.first < r; });
+        if (it == counts.end() || it->first != label_[vertex]) {
+            it = counts.insert(it, std::make_pair(label_[vertex], 0u));
+        }
+        it->second += unsigned(num_samples_ - since_[vertex]);
+    }
+    return counts;
+}
+
+uint_vec_t marginals_t::max_marginal() const {
+    uint_vec_t labels(label_.size(), 0);
+    for (size_t v = 0; v < label_.size(); ++v) {
+        std::vector<entry_t> counts = counts_of(v);
+        if (counts.empty()) {
+            labels[v] = label_[v];
+            continue;
+        }
+        labels[v] = std::max_element(counts.begin(), counts.end(), [](const entry_t& a, const entry_t& b) {
+            return a.second < b.second;
+        })->first;
+    }
+    return labels;
+}
+
+bool marginals_t::save(const std::string& path) const {
+    std::ofstream file(path.c_str());
+    if (!file.is_open()) {
+        return false;
+    }
+    for (size_t v = 0; v < label_.size(); ++v) {
+        for (auto const& e: counts_of(v)) {
+            file << e.first << ":" << double(e.second) / double(num_samples_) << " ";
+        }
+        file << "\n";
+    }
+    return bool(file);
+}
@@ -0,0 +1,55 @@
+#ifndef MARGINALS_HH
+#define MARGINALS_HH
+
+#include <string>
+#include <utility>
+#include <vector>
+#include "types.hh"
+
+/* Per-vertex marginal distribution of the block labels over the samples of a chain.
+ *
+ * Counts are sparse: a vertex keeps one (label, count) entry per label it has held, plus its
+ * current label and the sample at which it took it. The samples spent in the current label are
+ * only credited when the vertex leaves it, so that sample() visits the vertices touched since the
+ * previous sample instead of all N vertices, and never a dense N x K matrix. */
+class marginals_t {
+public:
+    /* Start counting from the given state; no sample is taken yet. */
+    void reset(const uint_vec_t& memberships);
+
+    /* The label of vertex may have changed since the last sample. */
+    inline void touch(size_t vertex) noexcept {
+        if (!touched_[vertex]) {
+            touched_[vertex] = true;
+            touched_list_.push_back(unsigned(vertex));
+        }
+    }
+
+    /* Record the current state as one sample; memberships must be the vector passed to reset(),
+     * changed only at the vertices that were touched. */
+    void sample(const uint_vec_t& memberships) noexcept;
+
+    size_t num_samples() const noexcept { return num_samples_; }
+
+    /* Most frequent label of each vertex; ties go to the lowest label. */
+    uint_vec_t max_marginal() const;
+
+    /* Write one line per vertex, with "label:probability" pairs in increasing order of label.
+     * Returns true on success. */
+    bool save(const std::string& path) const;
+
+private:
+    using entry_t = std::pair<unsigned int, unsigned int>;  // label, number of samples
+
+    std::vector<std::vector<entry_t>> counts_;  // samples credited so far, sorted by label
+    uint_vec_t label_;
+    std::vector<size_t> since_;  // first sample in the current label
+    std::vector<bool> touched_;
+    uint_vec_t touched_list_;
+    size_t num_samples_{0};
+
+    /* Credited samples plus those spent in the current label. */
+    std::vector<entry_t> counts_of(size_t vertex) const;
+};
+
+#endif // MARGINALS_HH
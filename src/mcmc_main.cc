@@ -10,65 +10,67 @@
 #include <iostream>
 #include <chrono>
 #include <vector>
-#include <utility>
-#include <random>
 #include <string>
 // Boost
 #include <boost/program_options.hpp>
 // Program headers
 #include "types.hh"
-#include "blockmodel.hh"
+#include "bisbm.hh"
 #include "output_functions.hh"
-#include "metropolis_hasting.hh"
 #include "graph_utilities.hh"
-#include "support/util.hh"
+#include "membership_io.hh"
+#include "csr_graph.hh"
+#include "perf_counters.hh"
 #include "config.hh"
 
 namespace po = boost::program_options;
 
 int main(int argc, char const *argv[]) {
     /* ~~~~~ Program options ~~~~~~~*/
+    bisbm_options_t options;
     size_t KA{0};
     size_t KB{0};
     size_t NA{0};
     size_t NB{0};
     std::string edge_list_path;
+    std::string csr_path;
     std::string membership_path;
     uint_vec_t n;
     uint_vec_t mb;
     uint_vec_t y;
     uint_vec_t z;
-    size_t burn_in;
-    size_t sampling_steps;
-    size_t sampling_frequency;
-    size_t steps_await;
     bool randomize = false;
-    bool merge = false;
-    bool nature = false;
-    std::string cooling_schedule;
-    float_vec_t cooling_schedule_kwargs(2, 0);
-    size_t seed = 0;
-    double epsilon;
-    uint_vec_t types_init;
+    std::string marginals_path;
+    std::string output_path;
+    std::string output_format;
+    std::string perf_report_path;
 
     po::options_description description("Options");
     description.add_options()
             ("edge_list_path,e", po::value<std::string>(&edge_list_path), "Path to edge list file.")
-            ("membership_path", po::value<std::string>(&membership_path), "Path to membership file.")
+            ("csr_path", po::value<std::string>(&csr_path),
+             "Path to a binary CSR graph written by edgelist2csr (replaces -e; -y defaults to its header).")
+            ("membership_path", po::value<std::string>(&membership_path),
+             "Path to membership file, in text (one label per line) or binary (as written by --output_format binary).")
             ("mb", po::value<uint_vec_t>(&mb)->multitoken(), "Path to membership file.")
             ("n,n", po::value<uint_vec_t>(&n)->multitoken(), "Block sizes vector.\n")
             ("types,y", po::value<uint_vec_t>(&y)->multitoken(), "Block types vector. (when -v is on)\n")
-            ("burn_in,b", po::value<size_t>(&burn_in)->default_value(1000), "Burn-in time.")
-            ("sampling_steps,t", po::value<size_t>(&sampling_steps)->default_value(1000),
-             "Number of sampling steps in marginalize mode. Length of the simulated annealing process.")
-            ("sampling_frequency,f", po::value<size_t>(&sampling_frequency)->default_value(10),
-             "Number of step between each sample in marginalize mode. Unused in likelihood maximization mode.")
+            ("burn_in,b", po::value<size_t>(&options.burn_in)->default_value(1000), "Burn-in sweeps in marginalize mode.")
+            ("sampling_steps,t", po::value<size_t>(&options.sampling_steps)->default_value(1000),
+             "Number of sampling sweeps in marginalize mode. Length of the simulated annealing process.")
+            ("sampling_frequency,f", po::value<size_t>(&options.sampling_frequency)->default_value(10),
+             "Number of sweeps between each sample in marginalize mode. Unused in likelihood maximization mode.")
+            ("maximize", "Likelihood maximization mode, with simulated annealing (default).")
+            ("marginalize", "Marginalization mode: after -b sweeps of burn-in, sample the posterior every -f sweeps "\
+             "for -t sweeps and output the max-marginal partition.")
+            ("marginals_path", po::value<std::string>(&marginals_path),
+             "In marginalize mode, write the marginal probabilities of the labels of each vertex to this path.")
             ("bisbm_partition,z", po::value<uint_vec_t>(&z)->multitoken(), "bipartite number of blocks to be inferred.")
             ("uni", "Experimental use; Estimate K during marginalizing – Riolo's approach.")
-            ("cooling_schedule,c", po::value<std::string>(&cooling_schedule)->default_value("abrupt_cool"),
+            ("cooling_schedule,c", po::value<std::string>(&options.cooling_schedule)->default_value("abrupt_cool"),
              "Cooling schedule for the simulated annealing algorithm. Options are exponential, "\
-             "linear, logarithmic and constant.")
-            ("cooling_schedule_kwargs,a", po::value<float_vec_t>(&cooling_schedule_kwargs)->multitoken(),
+             "linear, logarithmic, constant, abrupt_cool and adaptive.")
+            ("cooling_schedule_kwargs,a", po::value<float_vec_t>(&options.cooling_schedule_kwargs)->multitoken(),
              "Additional arguments for the cooling schedule provided as a list of floats. "\
              "Depends on the choice of schedule:\n"\
              "Exponential: T_0 (init. temperature > 0)\n"\
@@ -77,10 +79,20 @@ int main(int argc, char const *argv[]) {
              "        eta (rate of decline).\n"\
              "Logarithmic: c (rate of decline)\n"\
              "             d (delay > 1)\n"\
-             "Constant: T (temperature > 0)")
-            ("steps_await,x", po::value<size_t>(&steps_await)->default_value(1000),
+             "Constant: T (temperature > 0)\n"\
+             "Abrupt cooling: tau (steps at temperature 1)\n"\
+             "Adaptive: T_0 (init. temperature > 0)\n"\
+             "          r_0 (init. target acceptance rate, in ]0,1[)\n"\
+             "          gamma (decay of the target per sweep, in ]0,1]).")
+            ("steps_await,x", po::value<size_t>(&options.steps_await)->default_value(1000),
              "Stop the algorithm after x successive sweeps occurred and both the max/min entropy values did not change.")
-            ("epsilon,E", po::value<double>(&epsilon)->default_value(1.),
+            ("converge_window", po::value<size_t>(&options.converge_window)->default_value(0),
+             "Also stop the annealing once the entropy and the acceptance rate of the last converge_window sweeps "\
+             "below temperature 1 have stabilised, by a Geweke test with batch means (0 disables the test; "\
+             "otherwise at least 20).")
+            ("converge_z", po::value<double>(&options.converge_z)->default_value(2.),
+             "Largest |z| of the Geweke test at which the chain is considered stable.")
+            ("epsilon,E", po::value<double>(&options.epsilon)->default_value(1.),
              "The parameter epsilon for faster vertex proposal moves (in Tiago Peixoto's prescription).")
             ("randomize,r",
              "Randomize initial block state.")
@@ -88,8 +100,49 @@ int main(int argc, char const *argv[]) {
              "Perform agglomerative merges to the initial block state.")
             ("nature,u",
              "Perform agglomerative merges to the natural initial block state.")
-            ("seed,d", po::value<size_t>(&seed),
-             "Seed of the pseudo random number generator (Mersenne-twister 19937). A random seed is used if seed is not specified.")
+            ("seed,d", po::value<size_t>(&options.seed),
+             "Seed of the pseudo random number generator (xoshiro256**), which draws every random choice of the run. "\
+             "A random seed is used if seed is not specified.")
+            ("chains", po::value<size_t>(&options.num_chains)->default_value(1),
+             "Number of independent annealing chains; chain i is seeded with seed + i and the partition of lowest "\
+             "entropy is output.")
+            ("threads", po::value<size_t>(&options.num_threads)->default_value(0),
+             "Number of threads running the chains or replicas, or evaluating the candidate splits when (Ka, Kb) "\
+             "exceed the initial memberships (0: one per hardware core).")
+            ("sweep_threads", po::value<size_t>(&options.sweep_threads)->default_value(1),
+             "Number of threads sharing each sweep of a single annealing chain (0: one per hardware core). See "\
+             "--sweep_mode.")
+            ("sweep_mode", po::value<std::string>(&options.sweep_mode)->default_value("async"),
+             "How the threads share a sweep. async: above 1 thread, they move disjoint slices of the vertices "\
+             "asynchronously, reading the block counts without locks; the run is then no longer reproducible from "\
+             "its seed. bulk: the vertices of each type are judged in parallel against the state at the start of "\
+             "their half-sweep, then the accepted moves are checked again and applied in order; the run is "\
+             "reproducible from its seed for any number of threads.")
+            ("replicas", po::value<size_t>(&options.num_replicas)->default_value(0),
+             "Number of replicas for parallel tempering (replica exchange); replaces simulated annealing when > 1.")
+            ("temperatures", po::value<float_vec_t>(&options.temperatures)->multitoken(),
+             "Lowest and highest temperature of the geometric ladder of replicas (default: 1 2).")
+            ("swap_interval", po::value<size_t>(&options.swap_interval)->default_value(1),
+             "Number of sweeps between two rounds of replica swap proposals.")
+            ("checkpoint", po::value<std::string>(&options.checkpoint_path),
+             "Path of a binary checkpoint written periodically during the simulated annealing.")
+            ("checkpoint_every", po::value<size_t>(&options.checkpoint_every)->default_value(100),
+             "Number of sweeps between two checkpoints.")
+            ("resume", po::value<std::string>(&options.resume_path),
+             "Resume the simulated annealing from a checkpoint. The other options must match those of the "\
+             "checkpointed run.")
+            ("merge_split", po::value<size_t>(&options.merge_split)->default_value(0),
+             "Number of merge-split moves proposed after every sweep of the annealing (0 disables them).")
+            ("merge_split_scans", po::value<size_t>(&options.merge_split_scans)->default_value(0),
+             "Number of restricted Gibbs scans refining the random launch state of a merge-split move.")
+            ("output_path", po::value<std::string>(&output_path),
+             "Write the output memberships to this path instead of stdout.")
+            ("output_format", po::value<std::string>(&output_format)->default_value("text"),
+             "Format of --output_path: text (one label per line, readable by --membership_path) or binary "\
+             "(packed labels after a header with Ka, Kb and the entropy).")
+            ("perf_report", po::value<std::string>(&perf_report_path),
+             "Write counters (proposals, acceptances, rejections, cache growths) and phase timings as JSON to "\
+             "this path at exit; \"-\" writes to stderr. Requires a build with LOGGING.")
             ("help,h", "Produce this help message.");
 
     po::variables_map var_map;
@@ -103,12 +156,34 @@ int main(int argc, char const *argv[]) {
         std::clog << description;
         return 0;
     }
-    if (var_map.count("edge_list_path") == 0) {
+    if (var_map.count("perf_report") > 0) {
+#if LOGGING
+        write_perf_report_at_exit(perf_report_path);
+#else
+        std::clog << "WARNING: --perf_report needs a build with LOGGING=ON; no report will be written.\n";
+#endif
+    }
+    if (output_format != "text" && output_format != "binary") {
+        std::cerr << "--output_format must be text or binary.\n";
+        return 1;
+    }
+    if (var_map.count("edge_list_path") == 0 && var_map.count("csr_path") == 0) {
         std::cerr << "edge_list_path is required (-e flag)\n";
         return 1;
     }
 
-    if (var_map.count("types") == 0) {
+    csr_graph_t csr;
+    if (var_map.count("csr_path") > 0) {
+        if (!csr.load(csr_path)) {
+            std::cerr << "Cannot load CSR graph " << csr_path << "\n";
+            return 1;
+        }
+        if (var_map.count("types") == 0) {
+            y = {unsigned(csr.na()), unsigned(csr.nb())};
+        }
+    }
+
+    if (var_map.count("types") == 0 && var_map.count("csr_path") == 0) {
         std::cerr << "types is required for bisbm mode (-y flag)\n";
         return 1;
     } else {
@@ -120,102 +195,13 @@ int main(int argc, char const *argv[]) {
         } else {
             NA = y[0];
             NB = y[1];
-            types_init.resize(NA + NB, 0);
-            unsigned shift = 0;
-            for (size_t r = 0; r < y.size(); ++r) {
-                for (size_t i = 0; i < y[r]; ++i) {
-                    types_init[shift + i] = unsigned(int(r));
-                }
-                shift += y[r];
-            }
         }
     }
-
-    if (var_map.count("cooling_schedule_kwargs") == 0) {
-        // defaults
-        if (cooling_schedule == "exponential") {
-            cooling_schedule_kwargs[0] = 1;
-            cooling_schedule_kwargs[1] = 0.99;
-        }
-        if (cooling_schedule == "linear") {
-            cooling_schedule_kwargs[0] = sampling_steps + 1;
-            cooling_schedule_kwargs[1] = 1;
-        }
-        if (cooling_schedule == "logarithmic") {
-            cooling_schedule_kwargs[0] = 1;
-            cooling_schedule_kwargs[1] = 1;
-        }
-        if (cooling_schedule == "constant") {
-            cooling_schedule_kwargs[0] = 1;
-        }
-        if (cooling_schedule == "abrupt_cool") {
-            cooling_schedule_kwargs[0] = steps_await;
-        }
-    } else {
-        // kwargs not defaulted, must check.
-        if (cooling_schedule == "exponential") {
-            if (cooling_schedule_kwargs[0] <= 0) {
-                std::cerr << "Invalid cooling schedule argument for linear schedule: T_0 must be grater than 0.\n";
-                std::cerr << "Passed value: T_0=" << cooling_schedule_kwargs[0] << "\n";
-                return 1;
-            }
-            if (cooling_schedule_kwargs[1] <= 0 || cooling_schedule_kwargs[1] >= 1) {
-                std::cerr
-                        << "Invalid cooling schedule argument for exponential schedule: alpha must be in ]0,1[.\n";
-                std::cerr << "Passed value: alpha=" << cooling_schedule_kwargs[1] << "\n";
-                return 1;
-            }
-        } else if (cooling_schedule == "linear") {
-            if (cooling_schedule_kwargs[0] <= 0) {
-                std::cerr << "Invalid cooling schedule argument for linear schedule: T_0 must be grater than 0.\n";
-                std::cerr << "Passed value: T_0=" << cooling_schedule_kwargs[0] << "\n";
-                return 1;
-            }
-            if (cooling_schedule_kwargs[1] <= 0 || cooling_schedule_kwargs[1] > cooling_schedule_kwargs[0]) {
-                std::cerr << "Invalid cooling schedule argument for linear schedule: eta must be in ]0, T_0].\n";
-                std::cerr << "Passed value: T_0=" << cooling_schedule_kwargs[0]
-                          << ", eta=" << cooling_schedule_kwargs[1] << "\n";
-                return 1;
-            }
-            if (cooling_schedule_kwargs[1] * sampling_steps > cooling_schedule_kwargs[0]) {
-                std::cerr
-                        << "Invalid cooling schedule argument for linear schedule: eta * sampling_steps must be smaller or equal to T_0.\n";
-                std::cerr << "Passed value: eta*sampling_steps=" << cooling_schedule_kwargs[1] * sampling_steps
-                          << ", T_0=" << cooling_schedule_kwargs[0] << "\n";
-                return 1;
-            }
-        } else if (cooling_schedule == "logarithmic") {
-            if (cooling_schedule_kwargs[0] <= 0) {
-                std::cerr
-                        << "Invalid cooling schedule argument for logarithmic schedule: c must be greater than 0.\n";
-                std::cerr << "Passed value: c=" << cooling_schedule_kwargs[0] << "\n";
-                return 1;
-            }
-            if (cooling_schedule_kwargs[1] <= 0) {
-                std::cerr
-                        << "Invalid cooling schedule argument for logarithmic schedule: d must be greater than 0.\n";
-                std::cerr << "Passed value: d=" << cooling_schedule_kwargs[1] << "\n";
-                return 1;
-            }
-        } else if (cooling_schedule == "constant") {
-            if (cooling_schedule_kwargs[0] <= 0) {
-                std::cerr
-                        << "Invalid cooling schedule argument for constant schedule: temperature must be greater than 0.\n";
-                std::cerr << "Passed value: T=" << cooling_schedule_kwargs[0] << "\n";
-                return 1;
-            }
-        } else if (cooling_schedule == "abrupt_cool") {
-            if (cooling_schedule_kwargs[0] <= 0) {
-                std::cerr
-                        << "Invalid cooling schedule argument for abrupt_cool schedule: tau must be larger than 0. \n";
-                std::cerr << "Passed value: tau=" << cooling_schedule_kwargs[0] << "\n";
-                return 1;
-            }
-        } else {
-            std::cerr << "Invalid cooling schedule. Options are exponential, linear, logarithmic, abrupt_cool.\n";
-            return 1;
-        }
+    if (var_map.count("csr_path") > 0 && (csr.na() != NA || csr.nb() != NB)) {
+        std::cerr << "The types (-y) do not match those of the CSR graph " << csr_path << "\n";
+        return 1;
     }
+
     if (var_map.count("epsilon") > 0) {
 //        std::clog << "An epsilon param is assigned; we will use Tiago Peixoto's smart MCMC moves. \n";
     } else {
@@ -227,19 +213,21 @@ int main(int argc, char const *argv[]) {
     if (var_map.count("randomize") > 0) {
         randomize = true;
     }
-    if (var_map.count("merge") > 0) {
-        merge = true;
-    }
-    if (var_map.count("nature") > 0) {
-        nature = true;
+    options.merge = var_map.count("merge") > 0;
+    options.nature = var_map.count("nature") > 0;
+    if (var_map.count("marginalize") > 0) {
+        if (var_map.count("maximize") > 0) {
+            std::cerr << "--marginalize and --maximize cannot be combined.\n";
+            return 1;
+        }
+        options.marginalize = true;
     }
     if (var_map.count("seed") == 0) {
         // seeding based on the clock
-        seed = (size_t) std::chrono::high_resolution_clock::now().time_since_epoch().count();
+        options.seed = (size_t) std::chrono::high_resolution_clock::now().time_since_epoch().count();
     }
 
     /* ~~~~~ Setup objects ~~~~~~~*/
-    std::mt19937 engine(seed);
     uint_vec_t memberships_init;
     size_t N = 0;
 
@@ -250,7 +238,7 @@ int main(int argc, char const *argv[]) {
             std::clog << "WARNING: error in loading memberships, read memberships from block sizes\n";
         } else {
             randomize = false;
-            // -n and -z are not needed
+            // -n is not needed
             n.assign(memberships_init.size(), 0);
             for (auto const &b: memberships_init) ++n[b];
             // initiate z
@@ -267,6 +255,14 @@ int main(int argc, char const *argv[]) {
                     max_n_kb = memberships_init[mb_];
                 }
             }
+            // (Ka, Kb) default to the number of groups in the file
+            if (var_map.count("bisbm_partition") > 0) {
+                KA = z[0];
+                KB = z[1];
+            } else {
+                KA = max_n_ka + 1;
+                KB = max_n_kb - max_n_ka;
+            }
             z[0] = max_n_ka + 1;
             z[1] = max_n_kb - max_n_ka;
             n.resize(z[0] + z[1], 0);
@@ -323,167 +319,83 @@ int main(int argc, char const *argv[]) {
         N = memberships_init.size();
     }
 
-    // sanity check for the "types"-vector
-    if (memberships_init.size() != types_init.size()) {
-        std::cerr << memberships_init.size() << ", " << types_init.size() << '\n';
-        std::cerr << "Types do not sum to the number of vertices!" << "\n";
-        return 1;
+    // Graph structure; a binary graph is used as loaded, a text edge list is packed into the same CSR layout
+    if (var_map.count("csr_path") == 0) {
+        edge_list_t edge_list;
+        if (!load_edge_list(edge_list, edge_list_path, options.num_threads)) {
+            std::cerr << "Cannot open edge list " << edge_list_path << "\n";
+            return 1;
+        }
+        csr = csr_graph_t(edge_list, N, NA, NB);
     }
 
-    // Graph structure
-    edge_list_t edge_list;
-    load_edge_list(edge_list, edge_list_path);
-    const adj_list_t adj_list = edge_to_adj(edge_list, N);
-    edge_list.clear();
-
-    // Bind proper Metropolis-Hasting algorithm
-    std::unique_ptr<metropolis_hasting> algorithm;
-    algorithm = std::make_unique<metropolis_hasting>();
-
-    float_vec_t agg_merge_kwargs;
-    agg_merge_kwargs.resize(1, 0.);
-
-    //blockmodel for the blocks
-    double sigma = 1.01;
-    if (merge) {
-        std::iota(memberships_init.begin(), memberships_init.end(), 0);
-        blockmodel_t blockmodel(memberships_init, types_init, NA + NB, NA, NB, epsilon, &adj_list);
-        memberships_init.clear();
-        types_init.clear();
-
-        blockmodel.init_bisbm();
-        if (nature) {
-            size_t tKA = NA;
-            size_t tKB = NB;
-            size_t tGroups = NA + NB;
-            size_t num_edges = blockmodel.get_num_edges();
-            size_t ceiling = ceil(sqrt(2 * num_edges) / 2);
-
-            while (tKA >= ceiling && tKB >= ceiling) {
-                blockmodel.agg_merge(engine, ceil(tGroups * (sigma - 1) / sigma), 10);
-                tKA = blockmodel.get_KA();
-                tKB = blockmodel.get_KB();
+    /* ~~~~~ Run ~~~~~~~*/
+    options.KA = KA;
+    options.KB = KB;
+    options.randomize = randomize;
+    bisbm_result_t result;
+    std::string error;
+    if (!bisbm_run(csr, memberships_init, options, result, error)) {
+        std::cerr << error;
+        return 1;
+    }
 
-                tGroups = tKA + tKB;
-                if (cooling_schedule == "abrupt_cool") {
-                    algorithm->anneal(blockmodel, &abrupt_cool_schedule, agg_merge_kwargs, (NA + NB) * 1,
-                                      steps_await, engine);
-                } else {
-                    std::cerr << "Only abrupt cooling annealing is supported.";
-                    return 1;
-                }
-            }
-        } else {
-            int_vec_t ka_s;
-            int_vec_t kb_s;
-            std::tie(ka_s, kb_s) = geospace(NA, KA, NB, KB, sigma);
-            for (size_t i = 0; i < ka_s.size() - 1; ++i) {
-                size_t diff_a = -(ka_s[i + 1] - ka_s[i]);
-                size_t diff_b = -(kb_s[i + 1] - kb_s[i]);
-                blockmodel.agg_merge(engine, diff_a, diff_b, 10);
-                if (i != ka_s.size() - 2) {
-                    if (cooling_schedule == "abrupt_cool") {
-                        algorithm->anneal(blockmodel, &abrupt_cool_schedule, agg_merge_kwargs, (NA + NB) * 1,
-                                          steps_await, engine);
-                    } else {
-                        std::cerr << "Only abrupt cooling annealing is supported.";
-                        return 1;
-                    }
-                }
-            }
+    if (!result.tempering.temperatures.empty()) {
+        const tempering_result_t& tempering = result.tempering;
+        for (size_t t = 0; t < tempering.temperatures.size(); ++t) {
+            std::clog << "T = " << tempering.temperatures[t] << ": acceptance ratio "
+                      << tempering.acceptance_rates[t] << "\n";
         }
-
-        algorithm->anneal(blockmodel, &abrupt_cool_schedule, cooling_schedule_kwargs, sampling_steps,
-                          steps_await, engine);
-        blockmodel.summary();
-        if (nature) {
-            std::cout << blockmodel.get_KA() << " " << blockmodel.get_KB() << " ";
+        for (size_t t = 0; t < tempering.swap_rates.size(); ++t) {
+            std::clog << "swap (" << tempering.temperatures[t] << ", " << tempering.temperatures[t + 1]
+                      << "): acceptance ratio " << tempering.swap_rates[t] << "\n";
         }
-        output_vec<uint_vec_t>(*blockmodel.get_memberships(), std::cout);
-    } else {
-        size_t ka{0};
-        size_t kb{0};
-        for (size_t t = 0; t < NA + NB; ++t) {
-            if (types_init[t] == 0 && memberships_init[t] > ka) {
-                ka = memberships_init[t];
-            } else if (types_init[t] == 1 && memberships_init[t] > kb) {
-                kb = memberships_init[t];
+        std::clog << "sweeps per replica: " << tempering.sweeps << "\n";
+    } else if (!result.chains.empty()) {
+        for (size_t i = 0; i < result.chains.size(); ++i) {
+            const chain_result_t& chain = result.chains[i];
+            std::clog << "chain " << i << " (seed " << chain.seed << "): "
+                      << "(Ka, Kb) = (" << chain.KA << ", " << chain.KB << "); "
+                      << "entropy: " << chain.entropy << "; "
+                      << "acceptance ratio " << chain.acceptance_rate << "; ";
+            if (options.converge_window > 0) {
+                std::clog << (chain.convergence.converged ? "converged" : "not converged") << " after "
+                          << chain.convergence.sweeps << " sweeps; ";
             }
+            std::clog << "time: " << chain.seconds << " s\n";
         }
-        kb -= ka;
-        ka += 1;
-        int diff_a = ka - KA;
-        int diff_b = kb - KB;
-        if (diff_a != 0 || diff_b != 0) {
-            blockmodel_t blockmodel(memberships_init, types_init, ka + kb, ka, kb, epsilon, &adj_list);
-            memberships_init.clear();
-            types_init.clear();
-            blockmodel.init_bisbm();
-            if (diff_a >= 0 && diff_b >= 0) {
-                int_vec_t ka_s;
-                int_vec_t kb_s;
-                std::tie(ka_s, kb_s) = geospace(KA + diff_a, KA, KB + diff_b, KB, sigma);
-                if (ka_s.size() == 1) {
-                    blockmodel.agg_merge(engine, diff_a, diff_b, 10);
-                }
-                for (size_t i = 0; i < ka_s.size() - 1; ++i) {
-                    diff_a = -(ka_s[i + 1] - ka_s[i]);
-                    diff_b = -(kb_s[i + 1] - kb_s[i]);
-                    blockmodel.agg_merge(engine, diff_a, diff_b, 10);
-                    if (i != ka_s.size() - 2) {
-                        if (cooling_schedule == "abrupt_cool") {
-                            algorithm->anneal(blockmodel, &abrupt_cool_schedule, agg_merge_kwargs, (NA + NB) * 1,
-                                              steps_await, engine);
-                        } else {
-                            std::cerr << "Only abrupt cooling annealing is supported.";
-                            return 1;
-                        }
-                    }
-                }
-            } else {
-                blockmodel.agg_merge(engine, diff_a, diff_b, 100);
-            }
-            algorithm->anneal(blockmodel, &abrupt_cool_schedule, cooling_schedule_kwargs, sampling_steps,
-                              steps_await, engine);
-            blockmodel.summary();
-            output_vec<uint_vec_t>(*blockmodel.get_memberships(), std::cout);
-        } else {
-            blockmodel_t blockmodel(memberships_init, types_init, KA + KB, KA, KB, epsilon, &adj_list);
-
-            memberships_init.clear();
-            types_init.clear();
-            if (randomize) {
-                blockmodel.shuffle_bisbm(engine, NA, NB);
-            } else {
-                blockmodel.init_bisbm();
-            }
-            double rate = 0;
-            if (cooling_schedule == "exponential") {
-                rate = algorithm->anneal(blockmodel, &exponential_schedule, cooling_schedule_kwargs, sampling_steps,
-                                         steps_await, engine);
-            }
-            if (cooling_schedule == "linear") {
-                rate = algorithm->anneal(blockmodel, &linear_schedule, cooling_schedule_kwargs, sampling_steps, steps_await,
-                                         engine);
-            }
-            if (cooling_schedule == "logarithmic") {
-                rate = algorithm->anneal(blockmodel, &logarithmic_schedule, cooling_schedule_kwargs, sampling_steps,
-                                         steps_await, engine);
-            }
-            if (cooling_schedule == "constant") {
-                rate = algorithm->anneal(blockmodel, &constant_schedule, cooling_schedule_kwargs, sampling_steps,
-                                         steps_await, engine);
-            }
-            if (cooling_schedule == "abrupt_cool") {
-                rate = algorithm->anneal(blockmodel, &abrupt_cool_schedule, cooling_schedule_kwargs, sampling_steps,
-                                         steps_await, engine);
-            }
-            std::clog << "acceptance ratio " << rate << "\n";
-            blockmodel.summary();
-            output_vec<uint_vec_t>(*blockmodel.get_memberships(), std::cout);
+        std::clog << "best chain: " << result.best_chain << "\n";
+    } else {
+        std::clog << "acceptance ratio " << result.acceptance_rate << "\n";
+        if (options.marginalize) {
+            std::clog << "samples: " << result.marginals.num_samples() << "\n";
+        } else if (options.converge_window > 0) {
+            const convergence_t& convergence = result.convergence;
+            std::clog << (convergence.converged ? "converged" : "not converged") << " after "
+                      << convergence.sweeps << " sweeps (z of entropy " << convergence.entropy_z
+                      << ", of acceptance ratio " << convergence.acceptance_z << ")\n";
         }
-
     }
-
+    std::clog << "(Ka, Kb) = (" << result.KA << ", " << result.KB << ") \n";
+    std::clog << "entropy: " << result.entropy << "\n";
+    if (options.marginalize && var_map.count("marginals_path") > 0 && !result.marginals.save(marginals_path)) {
+        std::cerr << "Cannot write the marginals to " << marginals_path << "\n";
+        return 1;
+    }
+    if (var_map.count("output_path") > 0) {
+        membership_info_t info;
+        info.KA = result.KA;
+        info.KB = result.KB;
+        info.entropy = result.entropy;
+        if (!save_memberships(result.memberships, info, output_path, output_format == "binary")) {
+            std::cerr << "Cannot write the memberships to " << output_path << "\n";
+            return 1;
+        }
+        return 0;
+    }
+    if (options.merge && options.nature) {
+        std::cout << result.KA << " " << result.KB << " ";
+    }
+    write_memberships(result.memberships, std::cout);
     return 0;
 }
@@ -0,0 +1,152 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+
+#include "membership_io.hh"
+#include "support/mapped_file.hh"
+
+static const char membership_magic[8] = {'B', 'I', 'S', 'B', 'M', 'M', 'B', '1'};
+static const uint32_t membership_version = 1;
+
+struct membership_header_t {
+    char magic[8];
+    uint32_t version;
+    uint32_t width;
+    uint64_t num_vertices;
+    uint64_t KA;
+    uint64_t KB;
+    double entropy;
+};
+
+template<typename T>
+static void unpack_labels(const char* data, size_t N, uint_vec_t& memberships) {
+    memberships.resize(N);
+    for (size_t i = 0; i < N; ++i) {
+        T label;
+        std::memcpy(&label, data + i * sizeof(T), sizeof(T));
+        memberships[i] = label;
+    }
+}
+
+template<typename T>
+static void pack_labels(const uint_vec_t& memberships, std::vector<char>& buffer) {
+    buffer.resize(memberships.size() * sizeof(T));
+    for (size_t i = 0; i < memberships.size(); ++i) {
+        T label = T(memberships[i]);
+        std::memcpy(&buffer[i * sizeof(T)], &label, sizeof(T));
+    }
+}
+
+static bool load_binary(const mapped_file_t& file, uint_vec_t& memberships, membership_info_t* info) {
+    membership_header_t header{};
+    if (file.size() < sizeof(header)) return false;
+    std::memcpy(&header, file.data(), sizeof(header));
+    if (header.version != membership_version || (header.width != 1 && header.width != 2 && header.width != 4)) {
+        return false;
+    }
+    if (file.size() != sizeof(header) + header.width * header.num_vertices) return false;
+    const char* data = file.data() + sizeof(header);
+    if (header.width == 1) {
+        unpack_labels<uint8_t>(data, header.num_vertices, memberships);
+    } else if (header.width == 2) {
+        unpack_labels<uint16_t>(data, header.num_vertices, memberships);
+    } else {
+        unpack_labels<uint32_t>(data, header.num_vertices, memberships);
+    }
+    if (info != nullptr) {
+        info->KA = header.KA;
+        info->KB = header.KB;
+        info->entropy = header.entropy;
+    }
+    return true;
+}
+
+/* First unsigned integer of every line in [begin, end); lines without one are skipped. */
+static void parse_labels(const char* begin, const char* end, uint_vec_t& memberships) {
+    const char* p = begin;
+    while (p < end) {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == '\r')) ++p;
+        if (p < end && *p >= '0' && *p <= '9') {
+            unsigned int label = 0;
+            while (p < end && *p >= '0' && *p <= '9') {
+                label = label * 10 + unsigned(*p - '0');
+                ++p;
+            }
+            memberships.push_back(label);
+        }
+        while (p < end && *p != '\n') ++p;
+        ++p;
+    }
+}
+
+bool load_memberships(uint_vec_t& memberships, const std::string& membership_path, membership_info_t* info) {
+    memberships.clear();
+    mapped_file_t file(membership_path);
+    if (!file.is_open()) return false;
+    if (file.size() >= sizeof(membership_magic)
+        && std::memcmp(file.data(), membership_magic, sizeof(membership_magic)) == 0) {
+        return load_binary(file, memberships, info);
+    }
+    parse_labels(file.data(), file.data() + file.size(), memberships);
+    return true;
+}
+
+/* Append label and then separator to buffer. */
+static inline void append_label(std::vector<char>& buffer, unsigned int label, char separator) {
+    char digits[10];
+    size_t n = 0;
+    do {
+        digits[n++] = char('0' + label % 10);
+        label /= 10;
+    } while (label != 0);
+    while (n > 0) {
+        buffer.push_back(digits[--n]);
+    }
+    buffer.push_back(separator);
+}
+
+static void format_labels(const uint_vec_t& memberships, char separator, std::vector<char>& buffer) {
+    buffer.clear();
+    buffer.reserve(memberships.size() * 4);
+    for (auto const& label: memberships) {
+        append_label(buffer, label, separator);
+    }
+}
+
+bool save_memberships(const uint_vec_t& memberships, const membership_info_t& info, const std::string& path,
+                      bool binary) {
+    std::ofstream file(path.c_str(), std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) return false;
+    std::vector<char> buffer;
+    if (binary) {
+        unsigned int max_label = memberships.empty() ? 0 : *std::max_element(memberships.begin(), memberships.end());
+        membership_header_t header{};
+        std::memcpy(header.magic, membership_magic, sizeof(membership_magic));
+        header.version = membership_version;
+        header.width = max_label <= UINT8_MAX ? 1 : max_label <= UINT16_MAX ? 2 : 4;
+        header.num_vertices = memberships.size();
+        header.KA = info.KA;
+        header.KB = info.KB;
+        header.entropy = info.entropy;
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        if (header.width == 1) {
+            pack_labels<uint8_t>(memberships, buffer);
+        } else if (header.width == 2) {
+            pack_labels<uint16_t>(memberships, buffer);
+        } else {
+            pack_labels<uint32_t>(memberships, buffer);
+        }
+    } else {
+        format_labels(memberships, '\n', buffer);
+    }
+    file.write(buffer.data(), buffer.size());
+    return bool(file);
+}
+
+void write_memberships(const uint_vec_t& memberships, std::ostream& stream) {
+    std::vector<char> buffer;
+    format_labels(memberships, ' ', buffer);
+    buffer.push_back('\n');
+    stream.write(buffer.data(), buffer.size());
+}
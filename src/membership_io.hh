@@ -0,0 +1,38 @@
+#ifndef MEMBERSHIP_IO_HH
+#define MEMBERSHIP_IO_HH
+
+#include <iostream>
+#include <string>
+#include "types.hh"
+
+/* Block memberships on disk, as text or binary.
+ *
+ * The text format has one label per line. The binary format stores the labels packed in the
+ * fewest bytes that hold the largest one, after a header with the (Ka, Kb) and the description
+ * length of the partition:
+ *   char[8]      magic "BISBMMB1"
+ *   uint32       version (1), uint32 width (bytes per label: 1, 2 or 4)
+ *   uint64       N, KA, KB
+ *   double       entropy
+ *   width[N]     labels
+ * in native endianness. */
+struct membership_info_t {
+    size_t KA{0};
+    size_t KB{0};
+    double entropy{0.};
+};
+
+/* Load memberships from a binary file, or else from a text file with the label of vertex i as the
+ * first integer of the i-th non-empty line. info is filled from the header of a binary file and
+ * left untouched for a text file. Returns true on success. */
+bool load_memberships(uint_vec_t& memberships, const std::string& membership_path,
+                      membership_info_t* info = nullptr);
+
+/* Write memberships to path, in binary or one label per line. Returns true on success. */
+bool save_memberships(const uint_vec_t& memberships, const membership_info_t& info, const std::string& path,
+                      bool binary);
+
+/* Write memberships on one line, each label followed by a space, as output_vec does. */
+void write_memberships(const uint_vec_t& memberships, std::ostream& stream);
+
+#endif // MEMBERSHIP_IO_HH
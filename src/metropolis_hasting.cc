@@ -1,107 +1,401 @@
+#include <thread>
+
 #include "metropolis_hasting.hh"
+#include "chains.hh"  // for parallel_for and warm_up_caches
+#include "perf_counters.hh"
 #include "support/cache.hh"
 #include "support/int_part.hh"
+#include "support/move_kernel.hh"
 
-// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-// Non class methods
-// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-// Implemented from
-// http://www.fys.ku.dk/~andresen/BAhome/ownpapers/permanents/annealSched.pdf
-double exponential_schedule(size_t t, float_vec_t cooling_schedule_kwargs) noexcept {
-    // kwargs is the speed of the exponential cooling.
-    return cooling_schedule_kwargs[0] * std::pow(cooling_schedule_kwargs[1], t);
-}
+static const size_t bulk_chunk_size = 4096;  // vertices drawing from one stream in a bulk-synchronous phase
 
-double linear_schedule(size_t t, float_vec_t cooling_schedule_kwargs) noexcept {
-    // kwargs are the initial temperature and a rate of linear cooling.
-    return cooling_schedule_kwargs[0] - cooling_schedule_kwargs[1] * t;
+static inline int bounded(int x, int lo, int hi) noexcept {
+    return std::max(lo, std::min(x, hi));
 }
 
-double logarithmic_schedule(size_t t, float_vec_t cooling_schedule_kwargs) noexcept {
-    // kwargs are the rate of linear cooling and a delay (typically 1).
-    return cooling_schedule_kwargs[0] / safelog_fast(t + cooling_schedule_kwargs[1]);
-}
+/* The terms of transition_ratio that depend only on the totals of r and s: the block degrees (m), the
+ * block sizes (n) and the number of vertices of the moving degree in each block (eta). */
+static inline void add_block_terms(int m0r, int m0s, int deg, int n_r_r, int n_r_s, int eta_r, int eta_s,
+                                   double& entropy0, double& entropy1) noexcept {
+    int m1r = m0r - deg;
+    int m1s = m0s + deg;
 
-double constant_schedule(size_t t, float_vec_t cooling_schedule_kwargs) noexcept {
-    // kwargs are the rate of linear cooling and a delay (typically 1).
-    return cooling_schedule_kwargs[0];
-}
+    entropy0 -= -lgamma_fast(m0r + 1);
+    entropy0 -= -lgamma_fast(m0s + 1);
 
-double abrupt_cool_schedule(size_t t, float_vec_t cooling_schedule_kwargs) noexcept {
-    // Does there exist a way to improve the cooling? Maybe make it an exponential decay one against an abrupt cooling?
-    if (t < cooling_schedule_kwargs[0]) {
-        return 1.;
-    } else {
-        return 0.;
-    }
+    entropy1 -= -lgamma_fast(m1r + 1);
+    entropy1 -= -lgamma_fast(m1s + 1);
+
+    // entropy from degree distribution
+    // Note: we do not need entropy from partition (cancels with the denominator of the entropy from degree dist)
+    // as well as entropy from edge counts (no change).
+    entropy0 += -lgamma_fast(eta_r + 1);
+    entropy0 += -lgamma_fast(eta_s + 1);
+
+    entropy1 += -lgamma_fast(eta_r - 1 + 1);
+    entropy1 += -lgamma_fast(eta_s + 1 + 1);
+
+    entropy0 += log_q(m0r, n_r_r);
+    entropy0 += log_q(m0s, n_r_s);
+
+    entropy1 += log_q(m1r, n_r_r - 1);
+    entropy1 += log_q(m1s, n_r_s + 1);
 }
 
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 // metropolis_hasting class
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 inline bool metropolis_hasting::step(blockmodel_t& blockmodel, size_t vtx, double temperature,
-        std::mt19937& engine) noexcept {
+        rng_t& engine) noexcept {
+    PERF_COUNT(proposals);
     moves_ = sample_proposal_distribution(blockmodel, vtx, engine);
     double a{0.};
     double dS = transition_ratio(blockmodel, moves_);
+    bool accepted = false;
     if (temperature == 0.) {
-        if (dS < 0) {
-            return blockmodel.apply_mcmc_moves(moves_, dS);
-        } else {
-            return false;
-        }
+        accepted = dS < 0 && blockmodel.apply_mcmc_moves(moves_, dS);
     } else {
         a = - 1. / temperature * dS + std::log(accu_r_);
-        if (a > 0.) {
-            return blockmodel.apply_mcmc_moves(moves_, dS);
-        } else if (random_real(engine) < std::exp(a)) {
-            return blockmodel.apply_mcmc_moves(moves_, dS);
+        if (a > 0. || random_real(engine) < std::exp(a)) {
+            accepted = blockmodel.apply_mcmc_moves(moves_, dS);
         }
     }
-    return false;
+    if (accepted) {
+        PERF_COUNT(accepted);
+        if (marginals_ != nullptr) {
+            marginals_->touch(vtx);
+        }
+    }
+    return accepted;
 }
 
+bool metropolis_hasting::async_step(blockmodel_t& blockmodel, size_t vtx, double temperature,
+                                    rng_t& engine) noexcept {
+    PERF_COUNT(proposals);
+    moves_.assign(1, blockmodel.propose_vertex_move(engine, vtx));
+    double dS = async_transition_ratio(blockmodel, moves_[0]);
+    if (!std::isfinite(dS)) {
+        return false;
+    }
+    bool accepted;
+    if (temperature == 0.) {
+        accepted = dS < 0 && blockmodel.apply_mcmc_move_async(moves_[0]);
+    } else {
+        double a = - 1. / temperature * dS + std::log(accu_r_);
+        accepted = (a > 0. || random_real(engine) < std::exp(a)) && blockmodel.apply_mcmc_move_async(moves_[0]);
+    }
+    if (accepted) {
+        PERF_COUNT(accepted);
+    }
+    return accepted;
+}
+
+inline bool metropolis_hasting::accept_move(double dS, double temperature, double uniform) const noexcept {
+    if (temperature == 0.) {
+        return dS < 0;
+    }
+    double a = - 1. / temperature * dS + std::log(accu_r_);
+    return a > 0. || uniform < std::exp(a);
+}
+
+void metropolis_hasting::bulk_evaluate(blockmodel_t& blockmodel, size_t vtx, double temperature, rng_t& engine,
+                                       bulk_step_t& step) noexcept {
+    PERF_COUNT(proposals);
+    step.move = blockmodel.propose_vertex_move(engine, vtx);
+    step.temperature = temperature;
+    step.uniform = random_real(engine);
+    moves_.assign(1, step.move);
+    step.candidate = accept_move(transition_ratio(blockmodel, moves_), temperature, step.uniform);
+}
+
+bool metropolis_hasting::bulk_commit(blockmodel_t& blockmodel, const bulk_step_t& step) noexcept {
+    moves_.assign(1, step.move);
+    double dS = transition_ratio(blockmodel, moves_);
+    if (!accept_move(dS, step.temperature, step.uniform) || !blockmodel.apply_mcmc_moves(moves_, dS)) {
+        return false;
+    }
+    PERF_COUNT(accepted);
+    return true;
+}
+
+template <class Schedule>
+void metropolis_hasting::async_sweep(blockmodel_t& blockmodel, const Schedule& cooling_schedule, size_t current_step,
+                                     std::vector<metropolis_hasting>& workers, size_t& accepted_steps, size_t& u,
+                                     rng_t& engine) noexcept {
+    const uint_vec_t& vlist = blockmodel.get_vlist();
+    size_t num_nodes = vlist.size();
+    std::vector<rng_t> engines;
+    for (size_t t = 0; t < num_threads_; ++t) {
+        engines.push_back(engine.split());
+    }
+    std::vector<size_t> accepted(num_threads_, 0);
+    std::vector<size_t> cooled(num_threads_, 0);
+    parallel_for(num_threads_, num_threads_, [&](size_t t) {
+        for (size_t vi = num_nodes * t / num_threads_; vi < num_nodes * (t + 1) / num_threads_; ++vi) {
+            double temperature = cooling_schedule(current_step + vi);
+            if (workers[t].async_step(blockmodel, vlist[vi], temperature, engines[t])) {
+                ++accepted[t];
+            }
+            if (temperature < 1.) {
+                ++cooled[t];
+            }
+        }
+    });
+    blockmodel.finish_async_sweep();
+    for (size_t t = 0; t < num_threads_; ++t) {
+        accepted_steps += accepted[t];
+        u += cooled[t];
+    }
+    if (blockmodel.entropy() < entropy_min_) {
+        entropy_min_ = blockmodel.entropy();
+        u = 0;
+    }
+}
+
+template <class Schedule>
+void metropolis_hasting::bulk_sweep(blockmodel_t& blockmodel, const Schedule& cooling_schedule, size_t current_step,
+                                    std::vector<metropolis_hasting>& workers, size_t& accepted_steps, size_t& u,
+                                    rng_t& engine) noexcept {
+    // The vertices of type a, then those of type b, each in the order of the shuffled vertex list
+    const uint_vec_t& vlist = blockmodel.get_vlist();
+    size_t na = size_t(blockmodel.get_na());
+    bulk_order_.clear();
+    for (auto const& v: vlist) {
+        if (v < na) {
+            bulk_order_.push_back(v);
+        }
+    }
+    size_t phases[3] = {0, bulk_order_.size(), vlist.size()};
+    for (auto const& v: vlist) {
+        if (v >= na) {
+            bulk_order_.push_back(v);
+        }
+    }
+    bulk_steps_.resize(vlist.size());
+    std::vector<rng_t> engines;
+    for (size_t phase = 0; phase < 2; ++phase) {
+        size_t begin = phases[phase];
+        size_t end = phases[phase + 1];
+        size_t num_chunks = (end - begin + bulk_chunk_size - 1) / bulk_chunk_size;
+        engines.clear();
+        for (size_t c = 0; c < num_chunks; ++c) {
+            engines.push_back(engine.split());
+        }
+        // Evaluate: no vertex of this type neighbours another, so their k rows are fixed during the phase,
+        // and every move is drawn and judged against the block counts at the start of the phase. Chunk c
+        // always draws from engines[c], whichever thread runs it.
+        parallel_for(num_threads_, num_threads_, [&](size_t t) {
+            for (size_t c = t; c < num_chunks; c += num_threads_) {
+                size_t chunk_end = std::min(end, begin + (c + 1) * bulk_chunk_size);
+                for (size_t i = begin + c * bulk_chunk_size; i < chunk_end; ++i) {
+                    workers[t].bulk_evaluate(blockmodel, bulk_order_[i], cooling_schedule(current_step + i),
+                                             engines[c], bulk_steps_[i]);
+                }
+            }
+        });
+        // Commit, in order: every accepted move is judged again against the current counts, with the same
+        // uniform draw, so that only moves that are still favourable are applied and the entropy stays exact.
+        for (size_t i = begin; i < end; ++i) {
+            const bulk_step_t& step = bulk_steps_[i];
+            if (step.candidate) {
+                if (step.move.source == step.move.target) {
+                    ++accepted_steps;
+                } else if (bulk_commit(blockmodel, step)) {
+                    ++accepted_steps;
+                    if (blockmodel.entropy() < entropy_min_) {
+                        entropy_min_ = blockmodel.entropy();
+                        u = 0;
+                    }
+                }
+            }
+            if (step.temperature < 1.) {
+                ++u;
+            }
+        }
+    }
+}
+
+template <class Schedule>
 double metropolis_hasting::anneal(
         blockmodel_t &blockmodel,
-        double (*cooling_schedule)(size_t, float_vec_t),
-        const float_vec_t& cooling_schedule_kwargs,
+        Schedule cooling_schedule,
         size_t duration,
         size_t steps_await,
-        std::mt19937 &engine) noexcept {
+        rng_t &engine) noexcept {
+    PERF_TIMER(anneal);
     size_t num_nodes = blockmodel.get_memberships()->size();
     size_t accepted_steps = 0;
     size_t u = 0;
+    size_t first_sweep = 0;
 
     entropy_min_ = std::numeric_limits<double>::infinity();
+    convergence_monitor_.clear();
+    convergence_ = convergence_t();
+    if (resuming_) {
+        first_sweep = resume_.sweep;
+        u = resume_.u;
+        accepted_steps = resume_.accepted_steps;
+        entropy_min_ = resume_.entropy_min;
+        resuming_ = false;
+    }
     auto all_sweeps = size_t(duration / num_nodes);
     double temperature{1};
     uint_vec_t& vlist = blockmodel.get_vlist();
-    for (size_t sweep = 0; sweep < all_sweeps; ++sweep) {
+
+    std::vector<metropolis_hasting> workers;  // for parallel sweeps, one per thread
+    q_cache_freeze_t freeze(num_threads_ > 1 || bulk_);
+    if (num_threads_ > 1 || bulk_) {
+        workers.resize(num_threads_);
+        // The caches and a table-backed schedule must not grow while the threads read them
+        const int_vec_t& m_r = *blockmodel.get_m_r();
+        const int_vec_t& n_r = *blockmodel.get_n_r();
+        warm_up_caches(blockmodel.get_num_edges(), blockmodel.get_na(), blockmodel.get_nb(),
+                       blockmodel.get_KA(), blockmodel.get_KB(), size_t(*std::max_element(m_r.begin(), m_r.end())),
+                       size_t(*std::max_element(n_r.begin(), n_r.end())));
+        cooling_schedule(all_sweeps * num_nodes);
+    }
+    for (size_t sweep = first_sweep; sweep < all_sweeps; ++sweep) {
         std::shuffle(vlist.begin(), vlist.end(), engine);
 
         size_t current_step = num_nodes * sweep;
-        for (size_t vi = 0; vi < vlist.size(); ++vi) {
-            temperature = cooling_schedule(current_step + vi, cooling_schedule_kwargs);
-            if (step(blockmodel, vlist[vi], temperature, engine)) {
-                ++accepted_steps;
-                if (blockmodel.get_entropy() < entropy_min_) {  // TODO: this can be improved
-                    entropy_min_ = blockmodel.get_entropy();
-                    u = 0;
+        size_t accepted_before = accepted_steps;
+        if (bulk_) {
+            bulk_sweep(blockmodel, cooling_schedule, current_step, workers, accepted_steps, u, engine);
+            temperature = cooling_schedule(current_step + num_nodes - 1);
+        } else if (num_threads_ > 1) {
+            async_sweep(blockmodel, cooling_schedule, current_step, workers, accepted_steps, u, engine);
+            temperature = cooling_schedule(current_step + num_nodes - 1);
+        } else {
+            if (Schedule::per_sweep) {
+                temperature = cooling_schedule(current_step);
+            }
+            for (size_t vi = 0; vi < vlist.size(); ++vi) {
+                if (!Schedule::per_sweep) {
+                    temperature = cooling_schedule(current_step + vi);
+                }
+                if (step(blockmodel, vlist[vi], temperature, engine)) {
+                    ++accepted_steps;
+                    if (blockmodel.entropy() < entropy_min_) {  // TODO: this can be improved
+                        entropy_min_ = blockmodel.entropy();
+                        u = 0;
+                    }
+                }
+                if (temperature < 1.) {
+                    ++u;
                 }
             }
-            if (temperature < 1.) {
-                ++u;
+        }
+        for (size_t m = 0; m < merge_split_per_sweep_; ++m) {
+            if (merge_split(blockmodel, temperature, engine) && blockmodel.entropy() < entropy_min_) {
+                entropy_min_ = blockmodel.entropy();
+                u = 0;
             }
         }
-        if (u >= steps_await) {
+        double sweep_rate = double(accepted_steps - accepted_before) / double(num_nodes);
+        cooling_schedule.end_sweep(sweep_rate);
+        convergence_.sweeps = sweep + 1;
+        if (convergence_monitor_.enabled()) {
+            if (temperature >= 1.) {
+                convergence_monitor_.clear();  // only the cooled part of the run is tested
+            } else if (convergence_monitor_.add(blockmodel.entropy(), sweep_rate)) {
+                convergence_.converged = true;
+            }
+            convergence_.entropy_z = convergence_monitor_.entropy_z();
+            convergence_.acceptance_z = convergence_monitor_.acceptance_z();
+        }
+        if (u >= steps_await || convergence_.converged) {
             return double(accepted_steps) / double((sweep + 1) * num_nodes);
         }
+        if (checkpoint_every_ > 0 && (sweep + 1) % checkpoint_every_ == 0) {
+            checkpoint_t checkpoint;
+            checkpoint.sweep = sweep + 1;
+            checkpoint.u = u;
+            checkpoint.accepted_steps = accepted_steps;
+            checkpoint.entropy_min = entropy_min_;
+            checkpoint.entropy = blockmodel.entropy();
+            checkpoint.KA = blockmodel.get_KA();
+            checkpoint.KB = blockmodel.get_KB();
+            checkpoint.memberships = *blockmodel.get_memberships();
+            checkpoint.vlist = vlist;
+            checkpoint.engine = engine;
+            if (!save_checkpoint(checkpoint, checkpoint_path_)) {
+                std::clog << "WARNING: could not write checkpoint to " << checkpoint_path_ << "\n";
+            }
+        }
     }
     return double(accepted_steps) / double(duration);  // TODO: check these numbers
 }
 
-inline double metropolis_hasting::transition_ratio(const blockmodel_t& blockmodel,
-                                     const std::vector<mcmc_move_t> &moves) noexcept {
+// The schedules of cooling_schedules.hh
+template double metropolis_hasting::anneal(blockmodel_t&, exponential_schedule_t, size_t, size_t, rng_t&) noexcept;
+template double metropolis_hasting::anneal(blockmodel_t&, linear_schedule_t, size_t, size_t, rng_t&) noexcept;
+template double metropolis_hasting::anneal(blockmodel_t&, logarithmic_schedule_t, size_t, size_t, rng_t&) noexcept;
+template double metropolis_hasting::anneal(blockmodel_t&, constant_schedule_t, size_t, size_t, rng_t&) noexcept;
+template double metropolis_hasting::anneal(blockmodel_t&, abrupt_cool_schedule_t, size_t, size_t, rng_t&) noexcept;
+template double metropolis_hasting::anneal(blockmodel_t&, adaptive_schedule_t, size_t, size_t, rng_t&) noexcept;
+
+double metropolis_hasting::marginalize(
+        blockmodel_t& blockmodel,
+        size_t burn_in,
+        size_t duration,
+        size_t frequency,
+        marginals_t& marginals,
+        rng_t& engine) noexcept {
+    PERF_TIMER(marginalize);
+    const uint_vec_t& memberships = *blockmodel.get_memberships();
+    size_t accepted_steps = 0;
+    uint_vec_t& vlist = blockmodel.get_vlist();
+    for (size_t sweep = 0; sweep < burn_in + duration; ++sweep) {
+        if (sweep == burn_in) {
+            marginals.reset(memberships);
+            marginals_ = &marginals;
+        }
+        std::shuffle(vlist.begin(), vlist.end(), engine);
+        for (auto const& v: vlist) {
+            if (step(blockmodel, v, 1., engine)) {
+                ++accepted_steps;
+            }
+        }
+        for (size_t m = 0; m < merge_split_per_sweep_; ++m) {
+            merge_split(blockmodel, 1., engine);
+        }
+        if (sweep >= burn_in && (sweep - burn_in + 1) % frequency == 0) {
+            marginals.sample(memberships);
+        }
+    }
+    marginals_ = nullptr;
+    return double(accepted_steps) / double((burn_in + duration) * vlist.size());
+}
+
+void metropolis_hasting::set_checkpoint(const std::string& path, size_t every) noexcept {
+    checkpoint_path_ = path;
+    checkpoint_every_ = every;
+}
+
+void metropolis_hasting::set_merge_split(size_t per_sweep, size_t scans) noexcept {
+    merge_split_per_sweep_ = per_sweep;
+    merge_split_scans_ = scans;
+}
+
+void metropolis_hasting::set_num_threads(size_t num_threads) noexcept {
+    num_threads_ = num_threads == 0 ? std::max(1u, std::thread::hardware_concurrency()) : num_threads;
+}
+
+void metropolis_hasting::set_bulk_synchronous(bool bulk) noexcept {
+    bulk_ = bulk;
+}
+
+void metropolis_hasting::set_convergence(size_t window, double z_max) noexcept {
+    convergence_monitor_.reset(window, z_max);
+}
+
+void metropolis_hasting::resume_from(const checkpoint_t& checkpoint) noexcept {
+    resume_ = checkpoint;
+    resuming_ = true;
+}
+
+double metropolis_hasting::transition_ratio(const blockmodel_t& blockmodel,
+                                            const std::vector<mcmc_move_t> &moves) noexcept {
     v_ = moves[0].vertex;
     r_ = moves[0].source;
     s_ = moves[0].target;
@@ -119,6 +413,7 @@ inline double metropolis_hasting::transition_ratio(const blockmodel_t& blockmode
     size_t KB = blockmodel.get_KB();
     double K = KA + KB;
     if ((r_ < KA && s_ >= KA) || (r_ >= KA && s_ < KA)) {
+        PERF_COUNT(rejected_cross_type);
         return std::numeric_limits<double>::infinity();
     }
 
@@ -135,52 +430,41 @@ inline double metropolis_hasting::transition_ratio(const blockmodel_t& blockmode
     int INT_eta_rk_r_deg = eta_rk->at(r_)[deg];
     int INT_eta_rk_s_deg = eta_rk->at(s_)[deg];
 
-    citer_m0_s = m0->at(s_).begin();
-
-    citer_padded_m0 = (*padded_m0).begin();
-    citer_m0_r = m0->at(r_).begin();
+    const int_vec_t &m0_r = (*m0)[r_];
+    const int_vec_t &m0_s = (*m0)[s_];
 
     int INT_padded_m0r = padded_m0->at(r_);
-    int INT_padded_m1r = INT_padded_m0r - deg;
-
     int INT_padded_m0s = padded_m0->at(s_);
-    int INT_padded_m1s = INT_padded_m0s + deg;
 
-    auto criterion = (r_ < KA) ? [](size_t a, size_t k) { return a >= k; } : [](size_t a, size_t k) { return a < k; };
-    for (auto const& _k: *ki ){
-        size_t index = &_k - &ki->at(0);
-        if (criterion(index, KA) && _k != 0) {
-            accu0 += _k * (*citer_m0_s + epsilon) / (*citer_padded_m0 + epsilon * K) / deg;
-            accu1 += _k * (*citer_m0_r - _k + epsilon) / (*citer_padded_m0 + epsilon * K) / deg;
-            entropy0 -= lgamma_fast(*citer_m0_r + 1);
-            entropy0 -= lgamma_fast(*citer_m0_s + 1);
-            entropy1 -= lgamma_fast(*citer_m0_r - _k + 1);
-            entropy1 -= lgamma_fast(*citer_m0_s + _k + 1);
-        }
-        ++citer_m0_s;
-        ++citer_padded_m0;
-        ++citer_m0_r;
+    bool vectorized = false;
+#if !SPARSE_BLOCK_COUNTS
+    // The blocks of the opposite type are the contiguous range [KA, K) or [0, KA), so the dense counts can be
+    // swept with SIMD. Every m + k + 1 is at most E + 1, which the lgamma table normally covers already.
+    if (__lgamma_cache.size() > size_t(blockmodel.get_num_edges()) + 1) {
+        move_kernel_args_t args{ki->data(), m0_r.data(), m0_s.data(), padded_m0->data(), __lgamma_cache.data(),
+                                r_ < KA ? KA : 0, r_ < KA ? KA + KB : KA, epsilon, epsilon * K};
+        move_kernel_sums_t sums = move_kernel(args);
+        accu0 = sums.accu0 / deg;
+        accu1 = sums.accu1 / deg;
+        entropy1 += sums.dS;
+        vectorized = true;
     }
-    entropy0 -= -lgamma_fast(INT_padded_m0r + 1);
-    entropy0 -= -lgamma_fast(INT_padded_m0s + 1);
-
-    entropy1 -= -lgamma_fast(INT_padded_m1r + 1);
-    entropy1 -= -lgamma_fast(INT_padded_m1s + 1);
-
-    // entropy from degree distribution
-    // Note: we do not need entropy from partition (cancels with the denominator of the entropy from degree dist)
-    // as well as entropy from edge counts (no change).
-    entropy0 += -lgamma_fast(INT_eta_rk_r_deg + 1);
-    entropy0 += -lgamma_fast(INT_eta_rk_s_deg + 1);
-
-    entropy1 += -lgamma_fast(INT_eta_rk_r_deg - 1 + 1);
-    entropy1 += -lgamma_fast(INT_eta_rk_s_deg + 1 + 1);
-
-    entropy0 += log_q(INT_padded_m0r, INT_n_r_r);
-    entropy0 += log_q(INT_padded_m0s, INT_n_r_s);
-
-    entropy1 += log_q(INT_padded_m1r, INT_n_r_r - 1);
-    entropy1 += log_q(INT_padded_m1s, INT_n_r_s + 1);
+#endif
+    if (!vectorized) {
+        auto criterion = (r_ < KA) ? [](size_t a, size_t k) { return a >= k; } : [](size_t a, size_t k) { return a < k; };
+        ki->for_each([&](size_t index, int _k) {
+            if (criterion(index, KA)) {
+                accu0 += _k * (m0_s[index] + epsilon) / ((*padded_m0)[index] + epsilon * K) / deg;
+                accu1 += _k * (m0_r[index] - _k + epsilon) / ((*padded_m0)[index] + epsilon * K) / deg;
+                entropy0 -= lgamma_fast(m0_r[index] + 1);
+                entropy0 -= lgamma_fast(m0_s[index] + 1);
+                entropy1 -= lgamma_fast(m0_r[index] - _k + 1);
+                entropy1 -= lgamma_fast(m0_s[index] + _k + 1);
+            }
+        });
+    }
+    add_block_terms(INT_padded_m0r, INT_padded_m0s, deg, INT_n_r_r, INT_n_r_s, INT_eta_rk_r_deg, INT_eta_rk_s_deg,
+                    entropy0, entropy1);
 
     if (deg == 0) {
         accu_r_ = 1;
@@ -191,9 +475,201 @@ inline double metropolis_hasting::transition_ratio(const blockmodel_t& blockmode
     return entropy1 - entropy0;
 }
 
+double metropolis_hasting::async_transition_ratio(const blockmodel_t& blockmodel, const mcmc_move_t& move) noexcept {
+#if SPARSE_BLOCK_COUNTS
+    return std::numeric_limits<double>::infinity();  // asynchronous sweeps need the dense counts
+#else
+    size_t v = move.vertex;
+    size_t r = move.source;
+    size_t s = move.target;
+    if (r == s) {
+        accu_r_ = 1.;
+        return 0.;
+    }
+    size_t KA = blockmodel.get_KA();
+    size_t K = KA + blockmodel.get_KB();
+    if ((r < KA) != (s < KA)) {
+        PERF_COUNT(rejected_cross_type);
+        return std::numeric_limits<double>::infinity();
+    }
+    double epsilon = blockmodel.get_epsilon();
+    int E = blockmodel.get_num_edges();
+    int deg = blockmodel.get_degree(v);
+    const block_counts_t& k = *blockmodel.get_k(v);
+    const int* m_r = (*blockmodel.get_m())[r].data();
+    const int* m_s = (*blockmodel.get_m())[s].data();
+    const int_vec_t& m_t = *blockmodel.get_m_r();
+    const int_vec_t& n_r = *blockmodel.get_n_r();
+    const uint_mat_t& eta = *blockmodel.get_eta_rk_();
+
+    // Snapshot the columns of the opposite type, bounded so that 0 <= m_rt - k_t and m_st + k_t <= 2E: the
+    // rows of m may have drifted, even below zero, and every lgamma index stays within the warmed-up table.
+    size_t lo = r < KA ? KA : 0;
+    size_t n = (r < KA ? K : KA) - lo;
+    async_k_.resize(n);
+    async_m_r_.resize(n);
+    async_m_s_.resize(n);
+    async_m_t_.resize(n);
+    for (size_t t = 0; t < n; ++t) {
+        int k_t = bounded(k.load_atomic(lo + t), 0, deg);
+        async_k_[t] = k_t;
+        async_m_r_[t] = bounded(atomic_load(m_r[lo + t]), k_t, E);
+        async_m_s_[t] = bounded(atomic_load(m_s[lo + t]), 0, E);
+        async_m_t_[t] = bounded(atomic_load(m_t[lo + t]), 0, E);
+    }
+    move_kernel_args_t args{async_k_.data(), async_m_r_.data(), async_m_s_.data(), async_m_t_.data(),
+                            __lgamma_cache.data(), 0, n, epsilon, epsilon * K};
+    move_kernel_sums_t sums = move_kernel(args);
+
+    // n_r, eta_rk and m_r are exact up to the moves in flight, and the vertex still counts in r.
+    int m0r = bounded(atomic_load(m_t[r]), deg, E);
+    int m0s = bounded(atomic_load(m_t[s]), 0, E - deg);
+    int n_r_r = std::max(atomic_load(n_r[r]), 1);
+    int n_r_s = std::max(atomic_load(n_r[s]), 0);
+    int eta_r = std::max(int(atomic_load(eta[r][deg])), 1);
+    int eta_s = std::max(int(atomic_load(eta[s][deg])), 0);
+    double entropy0 = 0.;
+    double entropy1 = sums.dS;
+    add_block_terms(m0r, m0s, deg, n_r_r, n_r_s, eta_r, eta_s, entropy0, entropy1);
+
+    accu_r_ = deg == 0 ? 1. : sums.accu1 / sums.accu0;
+    return entropy1 - entropy0;
+#endif
+}
+
 /* Implementation for the single vertex change (SBM) */
-inline std::vector<mcmc_move_t> metropolis_hasting::sample_proposal_distribution(blockmodel_t& blockmodel,
-                                                                 size_t vtx,
-                                                                 std::mt19937& engine) const noexcept {
+std::vector<mcmc_move_t> metropolis_hasting::sample_proposal_distribution(blockmodel_t& blockmodel,
+                                                                          size_t vtx,
+                                                                          rng_t& engine) const noexcept {
     return blockmodel.single_vertex_change(engine, vtx);
 }
+
+double metropolis_hasting::ms_move(blockmodel_t& blockmodel, size_t v, size_t t) noexcept {
+    ms_move_[0].vertex = v;
+    ms_move_[0].source = (*blockmodel.get_memberships())[v];
+    ms_move_[0].target = t;
+    if (ms_move_[0].source == t) {
+        return 0.;
+    }
+    double dS = transition_ratio(blockmodel, ms_move_);
+    blockmodel.apply_mcmc_moves(ms_move_, dS);  // never empties a or b, which hold i and j
+    if (marginals_ != nullptr) {
+        marginals_->touch(v);
+    }
+    return dS;
+}
+
+double metropolis_hasting::ms_gibbs(blockmodel_t& blockmodel, size_t v, size_t a, size_t b, double beta,
+                                    size_t forced_to, rng_t& engine) noexcept {
+    size_t current = (*blockmodel.get_memberships())[v];
+    size_t other = current == a ? b : a;
+    ms_move_[0].vertex = v;
+    ms_move_[0].source = current;
+    ms_move_[0].target = other;
+    double x = beta * transition_ratio(blockmodel, ms_move_);
+    // log P(other) = -log(1 + e^x) and log P(current) = -log(1 + e^-x), computed without overflow
+    double log_p_other = -(std::max(x, 0.) + std::log1p(std::exp(-std::abs(x))));
+    double log_p_current = log_p_other + x;
+    bool to_other = (forced_to == a || forced_to == b) ? forced_to == other
+                                                       : random_real(engine) < std::exp(log_p_other);
+    if (to_other) {
+        ms_move(blockmodel, v, other);
+        return log_p_other;
+    }
+    return log_p_current;
+}
+
+bool metropolis_hasting::merge_split(blockmodel_t& blockmodel, double temperature, rng_t& engine) noexcept {
+    const uint_vec_t& memberships = *blockmodel.get_memberships();
+    size_t KA = blockmodel.get_KA();
+    size_t i = size_t(random_real(engine) * memberships.size());
+    size_t a = memberships[i];
+    size_t first = a < KA ? 0 : KA;
+    size_t num_groups = a < KA ? KA : blockmodel.get_KB();
+    if (num_groups < 2) {
+        return false;
+    }
+    PERF_COUNT(merge_split_proposals);
+    size_t b = first + size_t(random_real(engine) * (num_groups - 1));
+    if (b >= a) {
+        ++b;
+    }
+    int n_b = blockmodel.get_n_r()->at(b);
+    size_t j_order = size_t(random_real(engine) * n_b);
+
+    // The members of a and b, gathered from their member lists and sorted, so that the Gibbs scans visit
+    // them in an order that does not depend on the history of the moves; j is the j_order-th member of b.
+    const uint_vec_t& members_a = blockmodel.get_members(a);
+    const uint_vec_t& members_b = blockmodel.get_members(b);
+    ms_vertices_.assign(members_a.begin(), members_a.end());
+    ms_vertices_.insert(ms_vertices_.end(), members_b.begin(), members_b.end());
+    std::sort(ms_vertices_.begin(), ms_vertices_.end());
+    ms_current_.clear();
+    size_t order = 0;
+    size_t num = 0;
+    for (size_t k = 0; k < ms_vertices_.size(); ++k) {
+        unsigned v = ms_vertices_[k];
+        if (v == i || (memberships[v] == b && order++ == j_order)) {
+            continue;  // i or j
+        }
+        ms_vertices_[num++] = v;
+        ms_current_.push_back(memberships[v]);
+    }
+    ms_vertices_.resize(num);
+    if (ms_vertices_.empty()) {
+        return false;
+    }
+
+    // Gibbs scans sample exp(-beta S); at zero temperature the proposal stays at beta = 1.
+    double beta = temperature > 0. ? 1. / temperature : 1.;
+    double entropy0 = blockmodel.entropy();
+    size_t none = std::numeric_limits<size_t>::max();
+
+    // Launch state: a uniform random split refined by restricted Gibbs scans. It does not depend on the
+    // current split, which is what makes the forward and reverse proposal probabilities comparable.
+    for (size_t v = 0; v < num; ++v) {
+        ms_move(blockmodel, ms_vertices_[v], random_real(engine) < 0.5 ? a : b);
+    }
+    for (size_t scan = 0; scan < merge_split_scans_; ++scan) {
+        for (size_t v = 0; v < num; ++v) {
+            ms_gibbs(blockmodel, ms_vertices_[v], a, b, beta, none, engine);
+        }
+    }
+    ms_launch_.resize(num);
+    for (size_t v = 0; v < num; ++v) {
+        ms_launch_[v] = memberships[ms_vertices_[v]];
+    }
+
+    // Reverse move: probability that the last scan, started from the launch state, recreates the current split.
+    double log_q_reverse = 0.;
+    for (size_t v = 0; v < num; ++v) {
+        log_q_reverse += ms_gibbs(blockmodel, ms_vertices_[v], a, b, beta, ms_current_[v], engine);
+    }
+    for (size_t v = 0; v < num; ++v) {
+        ms_move(blockmodel, ms_vertices_[v], ms_launch_[v]);
+    }
+    // Forward move: the last scan draws the proposal.
+    double log_q_forward = 0.;
+    for (size_t v = 0; v < num; ++v) {
+        log_q_forward += ms_gibbs(blockmodel, ms_vertices_[v], a, b, beta, none, engine);
+    }
+
+    double dS = blockmodel.entropy() - entropy0;
+    bool accept;
+    if (temperature == 0.) {
+        accept = dS < 0;
+    } else {
+        // j is drawn among the members of b, so its probability enters the ratio as well.
+        double a_ms = -beta * dS + log_q_reverse - log_q_forward
+                      + std::log(double(n_b)) - std::log(double(blockmodel.get_n_r()->at(b)));
+        accept = a_ms > 0. || random_real(engine) < std::exp(a_ms);
+    }
+    if (accept) {
+        PERF_COUNT(merge_split_accepted);
+        return true;
+    }
+    for (size_t v = 0; v < num; ++v) {
+        ms_move(blockmodel, ms_vertices_[v], ms_current_[v]);
+    }
+    return false;
+}
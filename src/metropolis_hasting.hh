@@ -6,24 +6,16 @@
 #include <iostream>
 #include "types.hh"
 #include "blockmodel.hh"
+#include "checkpoint.hh"
+#include "convergence.hh"
+#include "cooling_schedules.hh"
+#include "marginals.hh"
 #include "output_functions.hh"
 #include "support/cache.hh"
 
-/* Cooling schedules */
-double exponential_schedule(size_t t, float_vec_t cooling_schedule_kwargs) noexcept;
-
-double linear_schedule(size_t t, float_vec_t cooling_schedule_kwargs) noexcept;
-
-double logarithmic_schedule(size_t t, float_vec_t cooling_schedule_kwargs) noexcept;
-
-double constant_schedule(size_t t, float_vec_t cooling_schedule_kwargs) noexcept;
-
-double abrupt_cool_schedule(size_t t, float_vec_t cooling_schedule_kwargs) noexcept;
-
 class metropolis_hasting {
 
 protected:
-    std::uniform_real_distribution<> random_real;
     double entropy_min_ = std::numeric_limits<double>::infinity();
     double accu_r_ = 0.;  // for Tiago Peixoto's smart MCMC
 
@@ -32,42 +24,181 @@ private:
 
 public:
     // Ctor
-    metropolis_hasting() : random_real(0, 1) {
+    metropolis_hasting() {
         ;
     }
 
     std::vector<mcmc_move_t> sample_proposal_distribution(
-            blockmodel_t& blockmodel, size_t vtx, std::mt19937& engine) const noexcept;
+            blockmodel_t& blockmodel, size_t vtx, rng_t& engine) const noexcept;
 
     // Common methods
-    inline bool step(blockmodel_t& blockmodel, size_t vtx, double temperature, std::mt19937 &engine) noexcept;
-
-    inline double transition_ratio(const blockmodel_t& blockmodel,
-                                         const std::vector<mcmc_move_t>& moves) noexcept;
-
+    inline bool step(blockmodel_t& blockmodel, size_t vtx, double temperature, rng_t &engine) noexcept;
+
+    double transition_ratio(const blockmodel_t& blockmodel,
+                            const std::vector<mcmc_move_t>& moves) noexcept;
+
+    /* Merge-split move on two groups a and b of the same type, which keeps (Ka, Kb) fixed.
+     *
+     * A vertex i is drawn uniformly, a is its group, b is another group of the same type and j
+     * a vertex of b. The other members of a and b are merged and split again at random,
+     * optionally refined by restricted Gibbs scans between a and b, with i and j held in
+     * place (the launch state). A last Gibbs scan draws the proposal; the same scan, forced
+     * to the current split, gives the probability of the reverse move (Jain & Neal, 2004).
+     * Returns true if the proposal was accepted. */
+    bool merge_split(blockmodel_t& blockmodel, double temperature, rng_t& engine) noexcept;
+
+    /* Anneal for `duration` steps at the temperatures of the cooling schedule (see cooling_schedules.hh),
+     * stopping early once steps_await steps below temperature 1 did not lower the entropy, or once the
+     * convergence test passes (see set_convergence). Returns the acceptance rate of the single-vertex
+     * moves. */
+    template <class Schedule>
     double anneal(blockmodel_t& blockmodel,
-                  double (*cooling_schedule)(size_t, float_vec_t),
-                  const float_vec_t& cooling_schedule_kwargs,
+                  Schedule cooling_schedule,
                   size_t duration,
                   size_t steps_await,
-                  std::mt19937 &engine) noexcept;
+                  rng_t &engine) noexcept;
+
+    /* Sample the posterior at temperature 1: burn_in sweeps, then `duration` sweeps during which the
+     * state is added to marginals every `frequency` sweeps. Merge-split moves are proposed as in
+     * anneal. Returns the acceptance rate of the single-vertex moves. */
+    double marginalize(blockmodel_t& blockmodel,
+                       size_t burn_in,
+                       size_t duration,
+                       size_t frequency,
+                       marginals_t& marginals,
+                       rng_t& engine) noexcept;
+
+    /* Write a checkpoint to path every `every` sweeps of anneal (0 disables checkpoints). */
+    void set_checkpoint(const std::string& path, size_t every) noexcept;
+
+    /* Propose `per_sweep` merge-split moves after every sweep of anneal, each with `scans`
+     * restricted Gibbs scans to build its launch state (0 moves disables them). */
+    void set_merge_split(size_t per_sweep, size_t scans) noexcept;
+
+    /* Run every sweep of anneal on num_threads threads (0: one per hardware core; 1: serial sweeps).
+     *
+     * An asynchronous sweep splits the shuffled vertex list into one contiguous slice per thread.
+     * Each thread proposes and accepts the moves of its slice against the shared blockmodel, whose
+     * counts it reads without locks while the other threads commit their moves with atomic updates
+     * (see blockmodel_t::apply_mcmc_move_async). A thread therefore sees the counts up to the moves
+     * in flight on the other threads: n_r, eta_rk and a k row are off by at most num_threads - 1,
+     * m_r by the degrees of at most num_threads - 1 vertices, and m by as much within a sweep,
+     * where two neighbours moving at once may even drive it below zero; the counts are bounded to
+     * consistent values before they are used (see async_transition_ratio).
+     * The blockmodel is made exact again after every sweep, so staleness never accumulates over
+     * sweeps, and steps_await, the lowest entropy, merge-split moves and checkpoints then work at
+     * the granularity of a sweep. The run is not reproducible from its seed. */
+    void set_num_threads(size_t num_threads) noexcept;
+
+    /* Run every sweep of anneal bulk-synchronously instead, on the threads of set_num_threads.
+     *
+     * A sweep has two phases, the vertices of type a and then those of type b. Since no two vertices
+     * of one type are neighbours, their k rows do not change while they move. In each phase, the
+     * threads first draw and judge a move for every vertex against the frozen state at the start of
+     * the phase; the moves that pass are then judged again against the current state and applied,
+     * serially and in sweep order, with the same uniform draws. The counts and the entropy stay
+     * exact, and the vertices of a phase draw from one stream per chunk of 4096, so that the run is
+     * reproducible from its seed for any number of threads. A move is proposed from counts that are
+     * stale by the earlier moves of its phase. The commit phase costs a transition_ratio per passing
+     * move, so the speedup is bounded by the inverse of the acceptance rate. */
+    void set_bulk_synchronous(bool bulk) noexcept;
+
+    /* Stop anneal once the entropy and acceptance rate of the last `window` sweeps below temperature 1
+     * have stabilised, as judged by convergence_monitor_t against z_max (0 sweeps disables the test). */
+    void set_convergence(size_t window, double z_max) noexcept;
+
+    /* Convergence test of the last call to anneal. */
+    const convergence_t& convergence() const noexcept { return convergence_; }
+
+    /* Make the next call to anneal continue from a checkpoint instead of starting at sweep 0.
+     * The blockmodel and the engine must have been restored from the same checkpoint. */
+    void resume_from(const checkpoint_t& checkpoint) noexcept;
 
 private:
+    std::string checkpoint_path_;
+    size_t checkpoint_every_{0};
+    bool resuming_{false};
+    checkpoint_t resume_;
+
+    size_t merge_split_per_sweep_{0};
+    size_t merge_split_scans_{0};
+    marginals_t* marginals_{nullptr};  // told about every accepted move while marginalize runs
+
+    size_t num_threads_{1};
+    bool bulk_{false};
+
+    /* A move of a bulk-synchronous phase, judged against the frozen state. */
+    struct bulk_step_t {
+        mcmc_move_t move;
+        double temperature;
+        double uniform;  // of the Metropolis test, reused when the move is committed
+        bool candidate;
+    };
+    uint_vec_t bulk_order_;  // the vertices of type a, then those of type b
+    std::vector<bulk_step_t> bulk_steps_;
+
+    /* Metropolis test of a move whose dS was just computed by transition_ratio. */
+    inline bool accept_move(double dS, double temperature, double uniform) const noexcept;
+
+    /* step() for asynchronous sweeps: it only calls the thread-safe methods of blockmodel, and
+     * rejects any move whose dS is not finite. */
+    bool async_step(blockmodel_t& blockmodel, size_t vtx, double temperature, rng_t& engine) noexcept;
+
+    /* transition_ratio for asynchronous sweeps. The counts it needs are read through relaxed atomic
+     * loads into the buffers below and bounded to values a consistent state could hold (m_rt >= k_t,
+     * no count below zero or above E), so that a drifted m never indexes outside the lgamma table. */
+    double async_transition_ratio(const blockmodel_t& blockmodel, const mcmc_move_t& move) noexcept;
+
+    int_vec_t async_k_;  // columns of the opposite type of k_v, m_r, m_s and m_t, in async_transition_ratio
+    int_vec_t async_m_r_;
+    int_vec_t async_m_s_;
+    int_vec_t async_m_t_;
+
+    /* Draw and judge the move of vtx for a bulk-synchronous phase; does not change blockmodel. */
+    void bulk_evaluate(blockmodel_t& blockmodel, size_t vtx, double temperature, rng_t& engine,
+                       bulk_step_t& step) noexcept;
+
+    /* Judge step again against the current state and apply it if it passes. */
+    bool bulk_commit(blockmodel_t& blockmodel, const bulk_step_t& step) noexcept;
+
+    template <class Schedule>
+    void async_sweep(blockmodel_t& blockmodel, const Schedule& cooling_schedule, size_t current_step,
+                     std::vector<metropolis_hasting>& workers, size_t& accepted_steps, size_t& u,
+                     rng_t& engine) noexcept;
+
+    template <class Schedule>
+    void bulk_sweep(blockmodel_t& blockmodel, const Schedule& cooling_schedule, size_t current_step,
+                    std::vector<metropolis_hasting>& workers, size_t& accepted_steps, size_t& u,
+                    rng_t& engine) noexcept;
+
+    convergence_monitor_t convergence_monitor_;
+    convergence_t convergence_;
+
+    std::vector<mcmc_move_t> ms_move_ = std::vector<mcmc_move_t>(1);
+    uint_vec_t ms_vertices_;  // members of a and b, other than i and j
+    uint_vec_t ms_current_;   // their groups before the move
+    uint_vec_t ms_launch_;    // their groups in the launch state
+
+    /* Move v to group t and return the change of description length. */
+    double ms_move(blockmodel_t& blockmodel, size_t v, size_t t) noexcept;
+
+    /* Gibbs update of v between groups a and b at inverse temperature beta. If forced_to is a or
+     * b, v is moved there; otherwise the group is drawn. Returns the log-probability of the
+     * outcome. */
+    double ms_gibbs(blockmodel_t& blockmodel, size_t v, size_t a, size_t b, double beta, size_t forced_to,
+                    rng_t& engine) noexcept;
+
     size_t v_{0};
     size_t r_{0};
     size_t s_{0};
 
     // TODO: how do we initiate values for these vectors? (or, should we?)
-    const int_vec_t* ki;
+    const block_counts_t* ki;
     const int_mat_t* m0;
     const int_vec_t* padded_m0;
     const uint_mat_t* eta_rk;
     const int_vec_t* n_r;
 
-    std::vector<int>::const_iterator citer_m0_r;
-    std::vector<int>::const_iterator citer_m0_s;
-    std::vector<int>::const_iterator citer_padded_m0;
-
 };
 
 #endif // METROPOLIS_HASTING_H
@@ -0,0 +1,110 @@
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <vector>
+
+#include "perf_counters.hh"
+
+static const char* const perf_counter_names[num_perf_counters] = {
+        "proposals", "accepted", "rejected_cross_type", "rejected_empty_group", "proposal_trees_built",
+        "lgamma_growths", "safelog_growths", "xlogx_growths", "q_cache_growths", "merge_split_proposals",
+        "merge_split_accepted"
+};
+
+static const char* const perf_phase_names[num_perf_phases] = {
+        "anneal", "marginalize", "agg_merge", "agg_split", "init_bisbm"
+};
+
+namespace {
+
+struct perf_registry_t {
+    std::mutex mutex;
+    std::vector<const perf_counters_t*> running;
+    perf_counters_t exited;
+    size_t num_threads{0};
+};
+
+perf_registry_t& perf_registry() {
+    static perf_registry_t registry;
+    return registry;
+}
+
+std::string perf_report_path;
+
+void write_perf_report_now() {
+    if (!write_perf_report(perf_report_path)) {
+        std::cerr << "Cannot write the performance report to " << perf_report_path << "\n";
+    }
+}
+
+}  // namespace
+
+void perf_counters_t::merge(const perf_counters_t& other) noexcept {
+    for (size_t i = 0; i < num_perf_counters; ++i) {
+        counts[i] += other.counts[i];
+    }
+    for (size_t i = 0; i < num_perf_phases; ++i) {
+        calls[i] += other.calls[i];
+        seconds[i] += other.seconds[i];
+    }
+}
+
+perf_thread_block_t::perf_thread_block_t() {
+    perf_registry_t& registry = perf_registry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    registry.running.push_back(&counters);
+    ++registry.num_threads;
+}
+
+perf_thread_block_t::~perf_thread_block_t() {
+    perf_registry_t& registry = perf_registry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    registry.exited.merge(counters);
+    registry.running.erase(std::remove(registry.running.begin(), registry.running.end(), &counters),
+                           registry.running.end());
+}
+
+perf_counters_t collect_perf_counters() noexcept {
+    perf_registry_t& registry = perf_registry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    perf_counters_t total = registry.exited;
+    for (auto const* counters: registry.running) {
+        total.merge(*counters);
+    }
+    return total;
+}
+
+bool write_perf_report(const std::string& path) {
+    perf_counters_t total = collect_perf_counters();
+    std::ofstream file;
+    if (path != "-") {
+        file.open(path.c_str());
+        if (!file.is_open()) {
+            return false;
+        }
+    }
+    std::ostream& out = path == "-" ? std::clog : file;
+
+    size_t proposals = total.counts[size_t(perf_counter_t::proposals)];
+    size_t accepted = total.counts[size_t(perf_counter_t::accepted)];
+    out << "{\n  \"threads\": " << perf_registry().num_threads << ",\n  \"counters\": {";
+    for (size_t i = 0; i < num_perf_counters; ++i) {
+        out << (i == 0 ? "\n" : ",\n") << "    \"" << perf_counter_names[i] << "\": " << total.counts[i];
+    }
+    out << ",\n    \"rejected\": " << (proposals >= accepted ? proposals - accepted : 0);
+    out << "\n  },\n  \"phases\": {";
+    for (size_t i = 0; i < num_perf_phases; ++i) {
+        out << (i == 0 ? "\n" : ",\n") << "    \"" << perf_phase_names[i] << "\": {\"calls\": " << total.calls[i]
+            << ", \"seconds\": " << total.seconds[i] << "}";
+    }
+    out << "\n  }\n}\n";
+    return bool(out);
+}
+
+void write_perf_report_at_exit(const std::string& path) {
+    perf_registry();  // constructed first, so that it is destroyed after the handler runs
+    perf_report_path = path;
+    std::atexit(write_perf_report_now);
+}
@@ -0,0 +1,99 @@
+#ifndef PERF_COUNTERS_HH
+#define PERF_COUNTERS_HH
+
+#include <chrono>
+#include <cstddef>
+#include <string>
+#include "config.hh"
+
+// Hot-path counters and phase timers, compiled in when LOGGING is set.
+//
+// Every thread counts into its own thread_local block, so that a count is a
+// plain increment on the hot path. A block is merged into the process-wide
+// total when its thread exits; collect_perf_counters() also adds the blocks
+// of the threads that are still running. With LOGGING off, PERF_COUNT and
+// PERF_TIMER expand to nothing.
+
+enum class perf_counter_t : size_t {
+    proposals,              // metropolis_hasting::step
+    accepted,               // single-vertex moves accepted by metropolis_hasting::step
+    rejected_cross_type,    // transition_ratio returned an infinite dS
+    rejected_empty_group,   // the empty-group guard in apply_mcmc_moves
+    proposal_trees_built,   // rows of the block matrix turned into Fenwick trees
+    lgamma_growths,         // init_lgamma grew the cache
+    safelog_growths,        // init_safelog grew the cache
+    xlogx_growths,          // init_xlogx grew the cache
+    q_cache_growths,        // init_q_cache grew or rebuilt the table
+    merge_split_proposals,  // metropolis_hasting::merge_split
+    merge_split_accepted,
+    num_counters
+};
+
+enum class perf_phase_t : size_t {
+    anneal,
+    marginalize,
+    agg_merge,
+    agg_split,
+    init_bisbm,
+    num_phases
+};
+
+constexpr size_t num_perf_counters = size_t(perf_counter_t::num_counters);
+constexpr size_t num_perf_phases = size_t(perf_phase_t::num_phases);
+
+struct perf_counters_t {
+    size_t counts[num_perf_counters]{};
+    size_t calls[num_perf_phases]{};
+    double seconds[num_perf_phases]{};  // inclusive: agg_merge contains its agg_split and init_bisbm calls
+
+    void merge(const perf_counters_t& other) noexcept;
+};
+
+/* Registers itself on construction and merges into the process-wide total on destruction. */
+struct perf_thread_block_t {
+    perf_counters_t counters;
+
+    perf_thread_block_t();
+
+    ~perf_thread_block_t();
+};
+
+inline perf_counters_t& local_perf_counters() noexcept {
+    static thread_local perf_thread_block_t block;
+    return block.counters;
+}
+
+/* Sum over the threads that have exited and those that are still running. */
+perf_counters_t collect_perf_counters() noexcept;
+
+/* Write the JSON report to path; "-" writes to std::clog. */
+bool write_perf_report(const std::string& path);
+
+/* Write the JSON report to path when the process exits normally. */
+void write_perf_report_at_exit(const std::string& path);
+
+class perf_timer_t {
+public:
+    explicit perf_timer_t(perf_phase_t phase) noexcept : phase_(size_t(phase)), start_(clock_t::now()) {}
+
+    ~perf_timer_t() {
+        perf_counters_t& counters = local_perf_counters();
+        ++counters.calls[phase_];
+        counters.seconds[phase_] += std::chrono::duration<double>(clock_t::now() - start_).count();
+    }
+
+private:
+    using clock_t = std::chrono::steady_clock;
+    size_t phase_;
+    clock_t::time_point start_;
+};
+
+#if LOGGING
+#define PERF_COUNT(counter) (++local_perf_counters().counts[size_t(perf_counter_t::counter)])
+#define PERF_TIMER(phase) perf_timer_t perf_timer_##phase##_(perf_phase_t::phase)
+#else
+#define PERF_COUNT(counter) ((void) 0)
+#define PERF_TIMER(phase) ((void) 0)
+#endif
+
+#endif // PERF_COUNTERS_HH
@@ -0,0 +1,36 @@
+#ifndef SBM_INFERENCE_ATOMIC_OPS_HH
+#define SBM_INFERENCE_ATOMIC_OPS_HH
+
+// Relaxed atomic loads and updates of plain integers, for the asynchronous sweeps.
+//
+// The block counts stay ordinary int and unsigned vectors, which the serial
+// code and the SIMD kernel read directly; the threads of an asynchronous
+// sweep read and update them through these GCC/Clang builtins. Relaxed
+// ordering is enough: every update is a commutative delta, so the counts are
+// exact once the threads have joined, whatever the interleaving.
+
+template <class T>
+inline T atomic_load(const T& x) noexcept { return __atomic_load_n(&x, __ATOMIC_RELAXED); }
+
+template <class T>
+inline void atomic_add(T& x, T delta) noexcept { __atomic_fetch_add(&x, delta, __ATOMIC_RELAXED); }
+
+template <class T>
+inline void atomic_sub(T& x, T delta) noexcept { __atomic_fetch_sub(&x, delta, __ATOMIC_RELAXED); }
+
+template <class T>
+inline void atomic_store(T& x, T value) noexcept { __atomic_store_n(&x, value, __ATOMIC_RELAXED); }
+
+/* Decrement x if it is greater than floor; returns false, leaving x untouched, otherwise. */
+template <class T>
+inline bool atomic_decrement_above(T& x, T floor) noexcept {
+    T current = __atomic_load_n(&x, __ATOMIC_RELAXED);
+    while (current > floor) {
+        if (__atomic_compare_exchange_n(&x, &current, current - 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+#endif //SBM_INFERENCE_ATOMIC_OPS_HH
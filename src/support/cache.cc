@@ -15,6 +15,7 @@
 // You should have received a copy of the GNU General Public License
 // along with this program. If not, see <http://www.gnu.org/licenses/>.
 #include "cache.hh"
+#include "../perf_counters.hh"
 
 using namespace std;
 
@@ -29,6 +30,7 @@ void init_safelog(size_t x)
         size_t old_size = __safelog_cache.size();
         if (x >= old_size)
         {
+            PERF_COUNT(safelog_growths);
             __safelog_cache.resize(x + 1);
             for (size_t i = old_size; i < __safelog_cache.size(); ++i)
                 __safelog_cache[i] = safelog(i);
@@ -49,6 +51,7 @@ void init_xlogx(size_t x)
         size_t old_size = __xlogx_cache.size();
         if (x >= old_size)
         {
+            PERF_COUNT(xlogx_growths);
             __xlogx_cache.resize(x + 1);
             for (size_t i = old_size; i < __xlogx_cache.size(); ++i)
                 __xlogx_cache[i] = xlogx(i);
@@ -68,6 +71,7 @@ void init_lgamma(size_t x)
         size_t old_size = __lgamma_cache.size();
         if (x >= old_size)
         {
+            PERF_COUNT(lgamma_growths);
             __lgamma_cache.resize(x + 1);
             if (old_size == 0)
                 __lgamma_cache[0] = numeric_limits<double>::infinity();
@@ -0,0 +1,55 @@
+#ifndef SBM_INFERENCE_DISJOINT_SET_HH
+#define SBM_INFERENCE_DISJOINT_SET_HH
+
+#include <vector>
+#include <numeric>
+#include <utility>
+#include <cstddef>
+
+// Disjoint-set (union-find) forest over the indices 0, ..., n - 1.
+//
+// Used by the agglomerative merges to group the blocks of the accepted merge
+// moves. The root of every set is its smallest index, which is the label the
+// merged blocks take; find() halves the paths it walks, so a round of merges
+// costs nearly linear time in the number of blocks.
+class disjoint_set_t {
+public:
+    /* n singletons. */
+    void reset(size_t n) {
+        parent_.resize(n);
+        std::iota(parent_.begin(), parent_.end(), 0);
+        size_.assign(n, 1);
+    }
+
+    inline size_t find(size_t i) noexcept {
+        while (parent_[i] != i) {
+            parent_[i] = parent_[parent_[i]];
+            i = parent_[i];
+        }
+        return i;
+    }
+
+    /* Merge the sets of i and j; returns false if they were already the same set. */
+    inline bool unite(size_t i, size_t j) noexcept {
+        i = find(i);
+        j = find(j);
+        if (i == j) {
+            return false;
+        }
+        if (j < i) {
+            std::swap(i, j);
+        }
+        parent_[j] = i;
+        size_[i] += size_[j];
+        return true;
+    }
+
+    /* Whether i has been merged with any other index. */
+    inline bool merged(size_t i) noexcept { return size_[find(i)] > 1; }
+
+private:
+    std::vector<size_t> parent_;
+    std::vector<size_t> size_;
+};
+
+#endif //SBM_INFERENCE_DISJOINT_SET_HH
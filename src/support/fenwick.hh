@@ -0,0 +1,80 @@
+#ifndef SBM_INFERENCE_FENWICK_HH
+#define SBM_INFERENCE_FENWICK_HH
+
+#include <vector>
+#include <cstddef>
+#include "atomic_ops.hh"
+
+// Partial-sum (Fenwick) tree over a vector of non-negative integer weights.
+//
+// Used to sample an index with probability proportional to its weight in
+// O(log n), while supporting O(log n) updates of single weights. This replaces
+// building a fresh std::discrete_distribution over a row of the block matrix
+// at every proposal.
+template <class T>
+class fenwick_tree_t {
+public:
+    /* Build the tree from a vector of weights in O(n). */
+    template <class Vec>
+    void assign(const Vec& weights) noexcept {
+        size_t n = weights.size();
+        tree_.assign(n + 1, 0);
+        total_ = 0;
+        for (size_t i = 0; i < n; ++i) {
+            tree_[i + 1] += weights[i];
+            total_ += weights[i];
+            size_t parent = (i + 1) + ((i + 1) & -(i + 1));
+            if (parent <= n) {
+                tree_[parent] += tree_[i + 1];
+            }
+        }
+        mask_ = 1;
+        while (mask_ <= n) {
+            mask_ <<= 1;
+        }
+        mask_ >>= 1;
+    }
+
+    /* Add delta to the weight at index i. */
+    inline void add(size_t i, T delta) noexcept {
+        total_ += delta;
+        for (++i; i < tree_.size(); i += i & -i) {
+            tree_[i] += delta;
+        }
+    }
+
+    /* add(), safe against concurrent add_atomic() calls; concurrent find() calls may see a partial update. */
+    inline void add_atomic(size_t i, T delta) noexcept {
+        atomic_add(total_, delta);
+        for (++i; i < tree_.size(); i += i & -i) {
+            atomic_add(tree_[i], delta);
+        }
+    }
+
+    // total() and find() read through relaxed atomic loads, which compile to plain loads, so that
+    // they can run alongside add_atomic().
+    inline T total() const noexcept { return atomic_load(total_); }
+
+    /* Index i such that prefix(i) <= u < prefix(i + 1), for u in [0, total()). */
+    inline size_t find(T u) const noexcept {
+        size_t pos = 0;
+        for (size_t step = mask_; step != 0; step >>= 1) {
+            size_t next = pos + step;
+            if (next < tree_.size()) {
+                T weight = atomic_load(tree_[next]);
+                if (weight <= u) {
+                    pos = next;
+                    u -= weight;
+                }
+            }
+        }
+        return pos;
+    }
+
+private:
+    std::vector<T> tree_;
+    T total_{0};
+    size_t mask_{0};
+};
+
+#endif //SBM_INFERENCE_FENWICK_HH
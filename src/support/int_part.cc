@@ -20,36 +20,75 @@
 
 #include "int_part.hh"
 #include "util.hh"
+#include "../perf_counters.hh"
 
 double spence(double);
 
 using namespace std;
 
-boost::multi_array<double, 2> __q_cache;
+std::vector<double> __q_cache;
+std::vector<size_t> __q_cache_offset;
+size_t __q_cache_k_max = 0;
+size_t __q_cache_frozen = 0;
 
 double log_sum(double a, double b) {
     return std::max(a, b) + std::log1p(exp(-abs(a - b)));
 }
 
-void init_q_cache(size_t n_max) {
-    size_t old_n = __q_cache.shape()[0];
-    if (old_n >= n_max)
+// Append row n (entries k = 0, ..., min(n, __q_cache_k_max)) to the table.
+// Entries with k > n are never stored and read as -infinity, as in the dense table.
+void append_q_row(size_t n) {
+    size_t width = std::min(n, __q_cache_k_max) + 1;
+    size_t base = __q_cache.size();
+    __q_cache.resize(base + width, -std::numeric_limits<double>::infinity());
+    __q_cache_offset.push_back(base + width);
+    if (n == 0)
         return;
 
-    __q_cache.resize(boost::extents[n_max + 1][n_max + 1]);
-    std::fill(__q_cache.data(), __q_cache.data() + __q_cache.num_elements(),
-              -std::numeric_limits<double>::infinity());
+    double* row = &__q_cache[base];
+    row[1] = 0;
+    for (size_t k = 2; k < width; ++k) {
+        row[k] = log_sum(row[k], row[k - 1]);
+        if (n > k) {
+            double q_nk = (k <= n - k) ? __q_cache[__q_cache_offset[n - k] + k]
+                                       : -std::numeric_limits<double>::infinity();
+            row[k] = log_sum(row[k], q_nk);
+        }
+    }
+}
 
-    for (size_t n = 1; n <= n_max; ++n) {
-        __q_cache[n][1] = 0;
-        for (size_t k = 2; k <= n; ++k) {
-            __q_cache[n][k] = log_sum(__q_cache[n][k], __q_cache[n][k - 1]);
-            if (n > k)
-                __q_cache[n][k] = log_sum(__q_cache[n][k], __q_cache[n - k][k]);
+void init_q_cache(size_t n_max, size_t k_max) {
+#pragma omp critical (_q_cache_)
+    {
+        n_max = std::min(n_max, __q_cache_n_max);
+        k_max = std::min(k_max, n_max);
+        size_t old_n = __q_cache_offset.empty() ? 0 : __q_cache_offset.size() - 1;
+        if (k_max > __q_cache_k_max) {
+            // Widening the band invalidates every row; rebuild with geometric
+            // headroom so that repeated widening stays amortized.
+            __q_cache_k_max = std::min(std::max(k_max, 2 * __q_cache_k_max), __q_cache_n_max);
+            n_max = std::max(n_max, old_n == 0 ? 0 : old_n - 1);
+            __q_cache.clear();
+            __q_cache_offset.assign(1, 0);
+            old_n = 0;
+        } else if (__q_cache_offset.empty()) {
+            __q_cache_offset.assign(1, 0);
+        }
+        if (old_n <= n_max) {
+            PERF_COUNT(q_cache_growths);
+        }
+        for (size_t n = old_n; n <= n_max; ++n) {
+            append_q_row(n);
         }
     }
 }
 
+void clear_q_cache() {
+    vector<double>().swap(__q_cache);
+    vector<size_t>().swap(__q_cache_offset);
+    __q_cache_k_max = 0;
+}
+
 double q_rec(int n, int k) {
     if (n <= 0 || k < 1)
         return 0;
@@ -10,19 +10,45 @@
 
 #include <cmath>
 #include <iostream>
-#include <boost/multi_array.hpp>
+#include <vector>
 
 #include "cache.hh"
 
 using namespace boost;
 
-void init_q_cache(size_t n_max);
+// Exact values of log q(n, k) are tabulated for n <= __q_cache_n_max; larger
+// arguments fall back to log_q_approx. The table is grown lazily: row n holds
+// the entries k = 0, ..., min(n, __q_cache_k_max), so its footprint is bounded
+// by the largest (m_r, n_r) pair the sampler actually asks for.
+constexpr size_t __q_cache_n_max = 10000;
+
+void init_q_cache(size_t n_max, size_t k_max);
+void clear_q_cache();
 double q_rec(int n, int k);
 double log_q_approx(size_t n, size_t k);
 double log_q_approx_big(size_t n, size_t k);
 double log_q_approx_small(size_t n, size_t k);
 
-extern boost::multi_array<double, 2> __q_cache;
+extern std::vector<double> __q_cache;
+extern std::vector<size_t> __q_cache_offset;  // start of row n in __q_cache
+extern size_t __q_cache_k_max;
+extern size_t __q_cache_frozen;  // number of live q_cache_freeze_t
+
+/* While an instance is alive, log_q never grows the table: arguments outside it fall back to
+ * log_q_approx, so that several threads can read the table at once. Create instances only while
+ * no other thread uses the table. */
+class q_cache_freeze_t {
+public:
+    explicit q_cache_freeze_t(bool freeze = true) noexcept : freeze_(freeze) { __q_cache_frozen += freeze_; }
+
+    ~q_cache_freeze_t() { __q_cache_frozen -= freeze_; }
+
+    q_cache_freeze_t(const q_cache_freeze_t&) = delete;
+    q_cache_freeze_t& operator=(const q_cache_freeze_t&) = delete;
+
+private:
+    bool freeze_;
+};
 
 template <class T>
 double log_q(T n, T k)
@@ -31,8 +57,16 @@ double log_q(T n, T k)
         return 0;
     if (k > n)
         k = n;
-    if (n < T(__q_cache.shape()[0]))
-        return __q_cache[n][k];
+    if (size_t(n) <= __q_cache_n_max)
+    {
+        if (size_t(n) + 1 >= __q_cache_offset.size() || size_t(k) > __q_cache_k_max)
+        {
+            if (__q_cache_frozen > 0)
+                return log_q_approx(n, k);
+            init_q_cache(n, k);
+        }
+        return __q_cache[__q_cache_offset[n] + k];
+    }
     return log_q_approx(n, k);
 }
 #endif //SBM_INFERENCE_INT_PART_HH
@@ -0,0 +1,76 @@
+#ifndef SBM_INFERENCE_MAPPED_FILE_HH
+#define SBM_INFERENCE_MAPPED_FILE_HH
+
+#include <cstddef>
+#include <fstream>
+#include <iterator>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Read-only view of a whole file.
+//
+// The file is memory-mapped when possible, so that it is read lazily through
+// the page cache and shared between processes. Files that cannot be mapped
+// (pipes, process substitution, ...) are read into memory instead.
+class mapped_file_t {
+public:
+    explicit mapped_file_t(const std::string& path) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return;
+        }
+        struct stat st{};
+        if (::fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+            size_ = size_t(st.st_size);
+            if (size_ == 0) {
+                ::close(fd);
+                open_ = true;
+                return;
+            }
+            void* addr = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (addr != MAP_FAILED) {
+                ::madvise(addr, size_, MADV_SEQUENTIAL);
+                data_ = static_cast<const char*>(addr);
+                mapped_ = true;
+                open_ = true;
+            }
+        }
+        ::close(fd);
+        if (!open_) {
+            std::ifstream file(path.c_str(), std::ios::binary);
+            if (!file.is_open()) {
+                return;
+            }
+            buffer_.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+            data_ = buffer_.data();
+            size_ = buffer_.size();
+            open_ = true;
+        }
+    }
+
+    ~mapped_file_t() {
+        if (mapped_) {
+            ::munmap(const_cast<char*>(data_), size_);
+        }
+    }
+
+    mapped_file_t(const mapped_file_t&) = delete;
+    mapped_file_t& operator=(const mapped_file_t&) = delete;
+
+    bool is_open() const noexcept { return open_; }
+    const char* data() const noexcept { return data_; }
+    size_t size() const noexcept { return size_; }
+
+private:
+    const char* data_{nullptr};
+    size_t size_{0};
+    bool mapped_{false};
+    bool open_{false};
+    std::string buffer_;
+};
+
+#endif //SBM_INFERENCE_MAPPED_FILE_HH
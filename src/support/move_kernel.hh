@@ -0,0 +1,45 @@
+#ifndef SBM_INFERENCE_MOVE_KERNEL_HH
+#define SBM_INFERENCE_MOVE_KERNEL_HH
+
+#include <cstddef>
+
+// Inner loop of metropolis_hasting::transition_ratio for a vertex of block
+// counts k moving from block r to block s.
+//
+// Over the contiguous range [lo, hi) of blocks of the opposite type, it sums
+//   accu0 = sum_t k_t (m_st + epsilon) / (m_t + epsilon K)
+//   accu1 = sum_t k_t (m_rt - k_t + epsilon) / (m_t + epsilon K)
+//   dS    = sum_t lgamma(m_rt + 1) + lgamma(m_st + 1) - lgamma(m_rt - k_t + 1) - lgamma(m_st + k_t + 1)
+// Columns with k_t = 0 contribute exactly zero; they are masked out rather than
+// computed, since their m_t may be 0 when epsilon is 0.
+//
+// The implementation is chosen once at runtime: AVX2 (gathering from the
+// lgamma table) on x86 CPUs that support it, with AVX-512 for ranges of
+// hundreds of blocks where available, and a scalar loop otherwise. The
+// BISBM_MOVE_KERNEL environment variable (avx2, scalar) caps the choice.
+// The lgamma table must cover every m_rt + 1 and m_st + k_t + 1.
+
+struct move_kernel_sums_t {
+    double accu0;
+    double accu1;
+    double dS;
+};
+
+struct move_kernel_args_t {
+    const int* k;
+    const int* m_r;   // row r of the block matrix
+    const int* m_s;   // row s of the block matrix
+    const int* m_t;   // total degree of each block
+    const double* lgamma;
+    size_t lo;
+    size_t hi;
+    double epsilon;
+    double epsilon_K;
+};
+
+move_kernel_sums_t move_kernel(const move_kernel_args_t& args) noexcept;
+
+/* "avx512", "avx2" or "scalar". */
+const char* move_kernel_name() noexcept;
+
+#endif // SBM_INFERENCE_MOVE_KERNEL_HH
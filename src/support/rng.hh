@@ -0,0 +1,113 @@
+#ifndef SBM_INFERENCE_RNG_HH
+#define SBM_INFERENCE_RNG_HH
+
+#include <array>
+#include <cstdint>
+#include <cstddef>
+#include <iostream>
+#include <limits>
+
+// Pseudo random number generator of the sampler: xoshiro256** (Blackman and
+// Vigna, 2018), with 32 bytes of state and a period of 2^256 - 1.
+//
+// It replaces std::mt19937, whose 5 KB of state was copied into every chain,
+// replica and checkpoint. Seeds are expanded with splitmix64, so that nearby
+// seeds (seed, seed + 1, ...) give unrelated streams, and split() hands out
+// non-overlapping streams of 2^128 draws, one per replica or per parallel job.
+// rng_t models UniformRandomBitGenerator, so it works with std::shuffle and
+// the <random> distributions; the code only names rng_t, so another generator
+// can be swapped in here.
+class xoshiro256ss_t {
+public:
+    using result_type = uint64_t;
+    using state_t = std::array<uint64_t, 4>;
+
+    explicit xoshiro256ss_t(uint64_t seed = 0) noexcept { this->seed(seed); }
+
+    void seed(uint64_t seed) noexcept {
+        for (auto& word: s_) {
+            seed += 0x9e3779b97f4a7c15ULL;
+            uint64_t z = seed;
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+            word = z ^ (z >> 31);
+        }
+    }
+
+    static constexpr result_type min() noexcept { return 0; }
+
+    static constexpr result_type max() noexcept { return std::numeric_limits<result_type>::max(); }
+
+    inline result_type operator()() noexcept {
+        const uint64_t result = rotl(s_[1] * 5, 7) * 9;
+        const uint64_t t = s_[1] << 17;
+        s_[2] ^= s_[0];
+        s_[3] ^= s_[1];
+        s_[1] ^= s_[2];
+        s_[0] ^= s_[3];
+        s_[2] ^= t;
+        s_[3] = rotl(s_[3], 45);
+        return result;
+    }
+
+    /* Advance by 2^128 draws. */
+    void jump() noexcept {
+        static const uint64_t polynomial[4] = {0x180ec6d33cfd0abaULL, 0xd5a61266f0c9392cULL,
+                                               0xa9582618e03fc9aaULL, 0x39abdc4529b1661cULL};
+        uint64_t s[4] = {0, 0, 0, 0};
+        for (auto const& word: polynomial) {
+            for (int b = 0; b < 64; ++b) {
+                if (word & (uint64_t(1) << b)) {
+                    for (int i = 0; i < 4; ++i) {
+                        s[i] ^= s_[i];
+                    }
+                }
+                (*this)();
+            }
+        }
+        for (int i = 0; i < 4; ++i) {
+            s_[i] = s[i];
+        }
+    }
+
+    /* A generator for the next 2^128 draws of this stream; this one jumps past them. */
+    xoshiro256ss_t split() noexcept {
+        xoshiro256ss_t child = *this;
+        jump();
+        return child;
+    }
+
+    /* The four words of the state, e.g. for checkpoints; a state of all zeros is not valid. */
+    state_t state() const noexcept { return state_t{{s_[0], s_[1], s_[2], s_[3]}}; }
+
+    void set_state(const state_t& state) noexcept {
+        for (int i = 0; i < 4; ++i) {
+            s_[i] = state[i];
+        }
+    }
+
+    friend bool operator==(const xoshiro256ss_t& a, const xoshiro256ss_t& b) noexcept {
+        return a.s_[0] == b.s_[0] && a.s_[1] == b.s_[1] && a.s_[2] == b.s_[2] && a.s_[3] == b.s_[3];
+    }
+
+    /* The state as four decimal integers, as std::mt19937 does. */
+    friend std::ostream& operator<<(std::ostream& stream, const xoshiro256ss_t& engine) {
+        return stream << engine.s_[0] << " " << engine.s_[1] << " " << engine.s_[2] << " " << engine.s_[3];
+    }
+
+    friend std::istream& operator>>(std::istream& stream, xoshiro256ss_t& engine) {
+        return stream >> engine.s_[0] >> engine.s_[1] >> engine.s_[2] >> engine.s_[3];
+    }
+
+private:
+    uint64_t s_[4];
+
+    static inline uint64_t rotl(uint64_t x, int k) noexcept { return (x << k) | (x >> (64 - k)); }
+};
+
+using rng_t = xoshiro256ss_t;
+
+/* Uniform double in [0, 1), from the top 53 bits of one draw. */
+inline double random_real(rng_t& engine) noexcept { return double(engine() >> 11) * (1. / 9007199254740992.); }
+
+#endif //SBM_INFERENCE_RNG_HH
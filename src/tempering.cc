@@ -0,0 +1,109 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <numeric>
+
+#include "tempering.hh"
+#include "chains.hh"
+#include "blockmodel.hh"
+#include "metropolis_hasting.hh"
+#include "support/int_part.hh"
+
+std::vector<double> geometric_ladder(double t_min, double t_max, size_t num_replicas) {
+    std::vector<double> temperatures(num_replicas, t_min);
+    for (size_t i = 1; i < num_replicas; ++i) {
+        temperatures[i] = t_min * std::pow(t_max / t_min, double(i) / double(num_replicas - 1));
+    }
+    return temperatures;
+}
+
+tempering_result_t run_tempering(const uint_vec_t& memberships, const uint_vec_t& types,
+                                 size_t NA, size_t NB, size_t KA, size_t KB, double epsilon,
+                                 const csr_graph_t* graph, bool randomize,
+                                 const std::vector<double>& temperatures,
+                                 size_t duration, size_t swap_interval,
+                                 size_t seed, size_t num_threads) {
+    size_t num_replicas = temperatures.size();
+    size_t num_nodes = NA + NB;
+    warm_up_caches(*graph, memberships, KA, KB);
+    q_cache_freeze_t freeze;
+
+    std::vector<std::unique_ptr<blockmodel_t>> replicas(num_replicas);
+    std::vector<metropolis_hasting> algorithms(num_replicas);
+    // one stream per replica, and the next one for the swaps
+    rng_t swap_engine(seed);
+    std::vector<rng_t> engines;
+    for (size_t i = 0; i < num_replicas; ++i) {
+        engines.push_back(swap_engine.split());
+        replicas[i] = std::make_unique<blockmodel_t>(memberships, types, KA + KB, KA, KB, epsilon, graph);
+        if (randomize) {
+            replicas[i]->shuffle_bisbm(engines[i], NA, NB);
+        } else {
+            replicas[i]->init_bisbm();
+        }
+    }
+
+    // at[t] is the replica currently sampled at temperatures[t]
+    std::vector<size_t> at(num_replicas);
+    std::iota(at.begin(), at.end(), 0);
+
+    tempering_result_t result;
+    result.temperatures = temperatures;
+    result.acceptance_rates.assign(num_replicas, 0.);
+    result.swap_rates.assign(num_replicas > 0 ? num_replicas - 1 : 0, 0.);
+    std::vector<size_t> swaps_proposed(result.swap_rates.size(), 0);
+    std::vector<size_t> swaps_accepted(result.swap_rates.size(), 0);
+    result.entropy = std::numeric_limits<double>::infinity();
+
+    auto keep_if_best = [&](size_t r) {
+        double S = replicas[r]->entropy();
+        if (S < result.entropy) {
+            result.entropy = S;
+            result.memberships = *replicas[r]->get_memberships();
+            result.KA = replicas[r]->get_KA();
+            result.KB = replicas[r]->get_KB();
+        }
+    };
+    for (size_t r = 0; r < num_replicas; ++r) {
+        keep_if_best(r);
+    }
+
+    size_t all_sweeps = duration / num_nodes;
+    size_t interval = std::max(swap_interval, size_t(1));
+    std::vector<double> accepted(num_replicas, 0.);
+    size_t round = 0;
+    for (size_t sweep = 0; sweep < all_sweeps; sweep += interval, ++round) {
+        size_t steps = std::min(interval, all_sweeps - sweep) * num_nodes;
+        parallel_for(num_replicas, num_threads, [&](size_t t) {
+            size_t r = at[t];
+            constant_schedule_t schedule(float(temperatures[t]));
+            double rate = algorithms[r].anneal(*replicas[r], schedule, steps, steps + 1, engines[r]);
+            accepted[t] += rate * steps;
+        });
+        for (size_t r = 0; r < num_replicas; ++r) {
+            keep_if_best(r);
+        }
+        for (size_t t = round % 2; t + 1 < num_replicas; t += 2) {
+            size_t a = at[t];
+            size_t b = at[t + 1];
+            double S_a = replicas[a]->entropy();
+            double S_b = replicas[b]->entropy();
+            double log_p = (1. / temperatures[t] - 1. / temperatures[t + 1]) * (S_a - S_b);
+            ++swaps_proposed[t];
+            if (log_p >= 0. || random_real(swap_engine) < std::exp(log_p)) {
+                std::swap(at[t], at[t + 1]);
+                ++swaps_accepted[t];
+            }
+        }
+        result.sweeps = sweep + steps / num_nodes;
+    }
+
+    for (size_t t = 0; t < num_replicas; ++t) {
+        result.acceptance_rates[t] = result.sweeps > 0 ? accepted[t] / double(result.sweeps * num_nodes) : 0.;
+    }
+    for (size_t t = 0; t < swaps_proposed.size(); ++t) {
+        result.swap_rates[t] = swaps_proposed[t] > 0 ? double(swaps_accepted[t]) / double(swaps_proposed[t]) : 0.;
+    }
+    return result;
+}
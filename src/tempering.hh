@@ -0,0 +1,38 @@
+#ifndef TEMPERING_HH
+#define TEMPERING_HH
+
+#include <cstddef>
+#include <vector>
+#include "types.hh"
+#include "csr_graph.hh"
+
+/* Outcome of a parallel tempering run. */
+struct tempering_result_t {
+    uint_vec_t memberships;  // lowest-entropy state visited by any replica
+    size_t KA{0};
+    size_t KB{0};
+    double entropy{0.};
+    size_t sweeps{0};  // sweeps performed by each replica
+    std::vector<double> temperatures;
+    std::vector<double> acceptance_rates;  // per temperature
+    std::vector<double> swap_rates;  // per pair of adjacent temperatures
+};
+
+/* Geometric ladder of num_replicas temperatures from t_min to t_max. */
+std::vector<double> geometric_ladder(double t_min, double t_max, size_t num_replicas);
+
+/* Replica exchange Monte Carlo.
+ *
+ * One replica of the blockmodel is kept per temperature. Replicas run swap_interval sweeps of
+ * single-vertex moves at their own temperature, in parallel, then swaps of temperatures between
+ * adjacent rungs of the ladder are proposed (even and odd pairs alternately) and accepted with
+ * probability min(1, exp((1/T_i - 1/T_j) * (S_i - S_j))). Replica i draws from the i-th
+ * stream split off an rng_t seeded with seed; the swaps use the stream after them. */
+tempering_result_t run_tempering(const uint_vec_t& memberships, const uint_vec_t& types,
+                                 size_t NA, size_t NB, size_t KA, size_t KB, double epsilon,
+                                 const csr_graph_t* graph, bool randomize,
+                                 const std::vector<double>& temperatures,
+                                 size_t duration, size_t swap_interval,
+                                 size_t seed, size_t num_threads);
+
+#endif // TEMPERING_HH